@@ -0,0 +1,303 @@
+#ifndef AUGMENTED_AVLBST_H
+#define AUGMENTED_AVLBST_H
+
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include "avlbst.h"
+
+// AVL tree with a monoid aggregate kept in every node.
+//
+// AugmentedAVLTree<Key, Value, Monoid> stores in each node the combination
+// of the values of its whole subtree, in key order. Monoid is a policy:
+//
+//   struct Monoid
+//   {
+//       typedef ... type;                           // the aggregate
+//       static type identity();                     // of no values
+//       static type lift(const Value& value);       // of one value
+//       static type combine(const type& left, const type& right);
+//   };
+//
+// combine must be associative; it need not be commutative, as the left
+// operand always holds the smaller keys. SumAggregate, MinAggregate,
+// MaxAggregate and CountAggregate are provided.
+//
+// The AVLTree hooks keep the aggregates right: insert and remove refresh
+// the path from the changed node to the root before any rotation, every
+// rotation recomputes its two nodes, nodeSwap() swaps aggregates along with
+// positions, and bulk loads compute them as the tree is built. aggregate(lo,
+// hi) then combines O(log n) stored aggregates.
+//
+// Values changed in place (through operator[] or an iterator) bypass the
+// hooks; change them with insert() instead.
+
+/**
+* Sum of the values. Value needs + and a zero default.
+*/
+template<typename Value>
+struct SumAggregate
+{
+    typedef Value type;
+
+    static type identity()
+    {
+        return Value();
+    }
+
+    static type lift(const Value& value)
+    {
+        return value;
+    }
+
+    static type combine(const type& left, const type& right)
+    {
+        return left + right;
+    }
+};
+
+/**
+* Smallest value; numeric_limits<Value>::max() for an empty range.
+*/
+template<typename Value>
+struct MinAggregate
+{
+    typedef Value type;
+
+    static type identity()
+    {
+        return std::numeric_limits<Value>::max();
+    }
+
+    static type lift(const Value& value)
+    {
+        return value;
+    }
+
+    static type combine(const type& left, const type& right)
+    {
+        return std::min(left, right);
+    }
+};
+
+/**
+* Largest value; numeric_limits<Value>::lowest() for an empty range.
+*/
+template<typename Value>
+struct MaxAggregate
+{
+    typedef Value type;
+
+    static type identity()
+    {
+        return std::numeric_limits<Value>::lowest();
+    }
+
+    static type lift(const Value& value)
+    {
+        return value;
+    }
+
+    static type combine(const type& left, const type& right)
+    {
+        return std::max(left, right);
+    }
+};
+
+/**
+* Number of entries, whatever the values; makes aggregate(lo, hi) a range
+* count and gives each node its subtree size.
+*/
+template<typename Value>
+struct CountAggregate
+{
+    typedef size_t type;
+
+    static type identity()
+    {
+        return 0;
+    }
+
+    static type lift(const Value&)
+    {
+        return 1;
+    }
+
+    static type combine(const type& left, const type& right)
+    {
+        return left + right;
+    }
+};
+
+/**
+* AVLNode plus the aggregate of its subtree.
+*/
+template<typename Key, typename Value, typename Monoid>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+        AVLNode<Key, Value>(key, value, parent),
+        aggregate_(Monoid::lift(value))
+    {
+
+    }
+
+    typename Monoid::type aggregate_;
+};
+
+template<typename Key, typename Value, typename Monoid>
+class AugmentedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename Monoid::type Aggregate;
+
+    Aggregate aggregate() const;
+    Aggregate aggregate(const Key& lo, const Key& hi) const;
+
+protected:
+    typedef AugmentedAVLNode<Key, Value, Monoid> AugmentedNode;
+
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void setBuiltBalance(Node<Key, Value>* n, int8_t balance);
+    virtual size_t nodeSize() const;
+    virtual void valueChanged(Node<Key, Value>* n);
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void augmentNode(AVLNode<Key, Value>* n);
+    virtual void augmentPath(AVLNode<Key, Value>* n);
+
+    static Aggregate subtree(Node<Key, Value>* n);
+};
+
+template<typename Key, typename Value, typename Monoid>
+Node<Key, Value>* AugmentedAVLTree<Key, Value, Monoid>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new AugmentedNode(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+/**
+* Bulk builds set each node's balance once its children are in place, which
+* is also when its aggregate can be computed.
+*/
+template<typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::setBuiltBalance(Node<Key, Value>* n, int8_t balance)
+{
+    AVLTree<Key, Value>::setBuiltBalance(n, balance);
+    augmentNode(static_cast<AVLNode<Key, Value>*>(n));
+}
+
+template<typename Key, typename Value, typename Monoid>
+size_t AugmentedAVLTree<Key, Value, Monoid>::nodeSize() const
+{
+    return sizeof(AugmentedNode);
+}
+
+template<typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::valueChanged(Node<Key, Value>* n)
+{
+    augmentPath(static_cast<AVLNode<Key, Value>*>(n));
+}
+
+/**
+* The aggregate describes a position's subtree, so it stays with the
+* position when the two nodes trade places.
+*/
+template<typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value>::nodeSwap(n1, n2);
+    std::swap(static_cast<AugmentedNode*>(n1)->aggregate_, static_cast<AugmentedNode*>(n2)->aggregate_);
+}
+
+template<typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::augmentNode(AVLNode<Key, Value>* n)
+{
+    static_cast<AugmentedNode*>(n)->aggregate_ = Monoid::combine(
+        Monoid::combine(subtree(n->getLeft()), Monoid::lift(n->getValue())),
+        subtree(n->getRight()));
+}
+
+template<typename Key, typename Value, typename Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::augmentPath(AVLNode<Key, Value>* n)
+{
+    while(n){
+        augmentNode(n);
+        n = n->getParent();
+    }
+}
+
+/**
+* Stored aggregate of the subtree at n; the identity for an empty one.
+*/
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::subtree(Node<Key, Value>* n)
+{
+    return n ? static_cast<AugmentedNode*>(n)->aggregate_ : Monoid::identity();
+}
+
+/**
+* Aggregate of every value in the tree, read off the root.
+*/
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::aggregate() const
+{
+    return subtree(this->root_);
+}
+
+/**
+* Aggregate of the values whose keys lie in [lo, hi], in key order. Descends
+* to the first node inside the range, then down both of its range edges,
+* taking whole stored subtrees that lie inside: O(log n) combines.
+*/
+template<typename Key, typename Value, typename Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid>::aggregate(const Key& lo, const Key& hi) const
+{
+    //the highest node with lo <= key <= hi: everything in range is below it
+    Node<Key, Value>* split = this->root_;
+    while(split){
+        if(split->getKey() < lo){
+            split = split->getRight();
+        }
+        else if(hi < split->getKey()){
+            split = split->getLeft();
+        }
+        else{
+            break;
+        }
+    }
+    if(!split){
+        return Monoid::identity();
+    }
+
+    //left edge: nodes with key >= lo come with their right subtrees, which
+    //lie after what is still to be found further down
+    Aggregate left = Monoid::identity();
+    for(Node<Key, Value>* n = split->getLeft(); n; ){
+        if(n->getKey() < lo){
+            n = n->getRight();
+        }
+        else{
+            left = Monoid::combine(Monoid::combine(Monoid::lift(n->getValue()), subtree(n->getRight())), left);
+            n = n->getLeft();
+        }
+    }
+
+    //right edge, mirrored
+    Aggregate right = Monoid::identity();
+    for(Node<Key, Value>* n = split->getRight(); n; ){
+        if(hi < n->getKey()){
+            n = n->getLeft();
+        }
+        else{
+            right = Monoid::combine(right, Monoid::combine(subtree(n->getLeft()), Monoid::lift(n->getValue())));
+            n = n->getRight();
+        }
+    }
+
+    return Monoid::combine(Monoid::combine(left, Monoid::lift(split->getValue())), right);
+}
+
+#endif
@@ -131,10 +131,16 @@ template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    using BinarySearchTree<Key, Value>::insert;
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* parent, const std::pair<const Key, Value>& new_item);
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void setBuiltBalance(Node<Key, Value>* n, int8_t balance);
+    virtual bool storedBalance(const Node<Key, Value>* n, int8_t& balance) const;
+    virtual size_t nodeSize() const;
     
     // Add helper functions here
     void insertFix(AVLNode<Key, Value>* child);
@@ -142,6 +148,10 @@ protected:
     void rotateLeft(AVLNode<Key, Value>* node);
     void removeFix(AVLNode<Key, Value>* n, int8_t diff);
 
+    // augmentation hooks, no-ops here (see augmented_avlbst.h)
+    virtual void augmentNode(AVLNode<Key, Value>* n);
+    virtual void augmentPath(AVLNode<Key, Value>* n);
+
 };
 
 /*
@@ -151,45 +161,51 @@ protected:
 template<class Key, class Value>
 void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
 {
-    AVLNode<Key, Value>* n = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-
-    if(!this->root_){
-        this->root_ = n;
+    Node<Key, Value>* parent = nullptr;
+    BST_STAT(++this->opStats_.inserts;)
+    Node<Key, Value>* match = this->searchParent(new_item.first, parent);
+
+    //if the keys are equal, change the value at the existing node
+    if(match){
+        match->setValue(new_item.second);
+        this->valueChanged(match);
         return;
     }
+    attachNode(parent, new_item);
+}
 
-    AVLNode<Key, Value>* current = dynamic_cast<AVLNode<Key, Value>*>(this->root_);
+/*
+ * Links a new AVLNode under parent and rebalances. Shared by insert() and the
+ * hinted insert in BinarySearchTree, so a hinted splice pays only for the
+ * (amortized constant) rebalancing.
+ */
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::attachNode(Node<Key, Value>* parent, const std::pair<const Key, Value> &new_item)
+{
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(parent);
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(createNode(new_item.first, new_item.second, current));
+    ++this->size_;
 
-    //traverse the tree
-    while(1){
-        //if the key of the new item is less than currents key, go to the left
-        if(n->getKey() < current->getKey()){
-            //if there is nothing to the left, then insert the new node
-            if(!current->getLeft()){
-                current->setLeft(n);
-                n->setParent(current);
-                break;
-            }
-            current = current->getLeft();
-        }
-        //if the key of the new item is grater than currents key, go to the right
-        else if(n->getKey() > current->getKey()){
-            //if there is nothing to the right, then insert the new node
-            if(!current->getRight()){
-                current->setRight(n);
-                n->setParent(current);
-                break;
-            }
-            current = current->getRight();
-        }
-        //if the keys are equal, change the value at current's key
-        else{
-            current->setValue(n->getValue());
-            delete n;
-            return;
+    if(!current){
+        this->root_ = n;
+        this->rightmost_ = n;
+        augmentPath(n);
+        return n;
+    }
+
+    if(n->getKey() < current->getKey()){
+        current->setLeft(n);
+    }
+    else{
+        current->setRight(n);
+        if(current == this->rightmost_){
+            this->rightmost_ = n;
         }
     }
+    //aggregates must be right before insertFix rotates anything
+    augmentPath(n);
 
+    BST_STAT(this->cascade_ = 0;)
     if(current->getBalance() == 1 || current->getBalance() == -1){
         current->setBalance(0);
     }
@@ -204,6 +220,33 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
         }
         insertFix(n);
     }
+    BST_STAT(this->recordCascade(this->cascade_);)
+    return n;
+}
+
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new AVLNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::setBuiltBalance(Node<Key, Value>* n, int8_t balance)
+{
+    static_cast<AVLNode<Key, Value>*>(n)->setBalance(balance);
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::storedBalance(const Node<Key, Value>* n, int8_t& balance) const
+{
+    balance = static_cast<const AVLNode<Key, Value>*>(n)->getBalance();
+    return true;
+}
+
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::nodeSize() const
+{
+    return sizeof(AVLNode<Key, Value>);
 }
 
 template<class Key, class Value>
@@ -220,6 +263,7 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* child){
     if(!grandparent){
         return;
     }
+    BST_STAT(++this->cascade_;)
 
     //if parent is the left child of grandparent
     if(parent == grandparent->getLeft()){
@@ -235,12 +279,14 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* child){
         else if(grandparent->getBalance() == -2){
             //zig zig (left left)
             if(parent->getLeft() == child){
+                BST_STAT(++this->opStats_.singleRotations;)
                 parent->setBalance(0);
                 grandparent->setBalance(0);
                 rotateRight(grandparent);
             }
             //zig zag (left right)
             else{
+                BST_STAT(++this->opStats_.doubleRotations;)
                 if(child->getBalance() == -1){
                     parent->setBalance(0);
                     grandparent->setBalance(1);
@@ -273,12 +319,14 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* child){
         else if(grandparent->getBalance() == 2){
             //zig zig (right right)
             if(parent->getRight() == child){
+                BST_STAT(++this->opStats_.singleRotations;)
                 parent->setBalance(0);
                 grandparent->setBalance(0);
                 rotateLeft(grandparent);
             }
             //zig zag (right left)
             else{
+                BST_STAT(++this->opStats_.doubleRotations;)
                 if(child->getBalance() == -1){
                     parent->setBalance(1);
                     grandparent->setBalance(0);
@@ -304,6 +352,7 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* child){
 
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node){
+    BST_STAT(++this->opStats_.rotateRights;)
 
     AVLNode<Key, Value>* left = node->getLeft();
     
@@ -334,10 +383,15 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node){
     if(node->getLeft()){
         node->getLeft()->setParent(node);
     }
+
+    //node is now below left, so it is recomputed first
+    augmentNode(node);
+    augmentNode(left);
 }
 
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node){
+    BST_STAT(++this->opStats_.rotateLefts;)
 
     AVLNode<Key, Value>* right = node->getRight();
 
@@ -368,6 +422,9 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node){
     if(node->getRight()){
         node->getRight()->setParent(node);
     }
+
+    augmentNode(node);
+    augmentNode(right);
 }
 
 
@@ -379,25 +436,34 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node){
 template<class Key, class Value>
 void AVLTree<Key, Value>:: remove(const Key& key)
 {
+    BST_STAT(++this->opStats_.removes;)
     //if the tree is empty, do nothing
     if(!this->root_){
+        BST_STAT(this->recordSearch(0, 0);)
         return;
     }
     //if there is just one node, delete the node and assign root to nullptr
     if(this->root_->getKey() == key && !this->root_->getLeft() && !this->root_->getRight()){
+        BST_STAT(this->recordSearch(1, 1);)
+        this->uncacheNode(this->root_);
         delete this->root_;
         this->root_ = nullptr;
+        this->rightmost_ = nullptr;
+        this->size_ = 0;
         return;
     }
 
     AVLNode<Key, Value>* current = dynamic_cast<AVLNode<Key, Value>*>(this->root_);
+    BST_STAT(uint64_t depth = 0; uint64_t comparisons = 0;)
     
     //traversing the tree
     while(1){
         //not found
         if(!current){
+            BST_STAT(this->recordSearch(depth, comparisons);)
             return;
         }
+        BST_STAT(++depth; ++comparisons;)
 
         //if the key is less than current, go to the left
         if(key < current->getKey()){
@@ -405,19 +471,29 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         }
         //if the key is greater than current, go to the right
         else if(key > current->getKey()){
+            BST_STAT(++comparisons;)
             current = current->getRight();
         }
         //found the node
         else{
+            BST_STAT(++comparisons;)
             break;
         }
     }
+    BST_STAT(this->recordSearch(depth, comparisons);)
+    this->uncacheNode(current);
+    --this->size_;
 
     //check if the node has 2 children, swap with its predecessor
     if(current->getLeft() && current->getRight()){
         nodeSwap(current, dynamic_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(current)));
     }
 
+    //if we are removing the largest node, its predecessor becomes the largest
+    if(current == this->rightmost_){
+        this->rightmost_ = BinarySearchTree<Key, Value>::predecessor(current);
+    }
+
     AVLNode<Key, Value>* parent = current->getParent();
 
     int8_t diff = 0;
@@ -484,7 +560,11 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         }
     }
     delete current;
+    //the subtrees that lost current, before removeFix rotates any of them
+    augmentPath(parent);
+    BST_STAT(this->cascade_ = 0;)
     removeFix(parent, diff);
+    BST_STAT(this->recordCascade(this->cascade_);)
 }
 
 template<class Key, class Value>
@@ -493,6 +573,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
     if (!n){
         return;
     }
+    BST_STAT(++this->cascade_;)
 
     //compute the next calls recursive arguments before altering the tree 
     AVLNode<Key, Value>* parent = n->getParent();
@@ -515,6 +596,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
             AVLNode<Key, Value>* child = n->getLeft();
             //case 1a
             if(child->getBalance() == -1){
+                BST_STAT(++this->opStats_.singleRotations;)
                 rotateRight(n);
                 n->setBalance(0);
                 child->setBalance(0);
@@ -523,6 +605,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
             }
             //case 1b
             else if(child->getBalance() == 0){
+                BST_STAT(++this->opStats_.singleRotations;)
                 rotateRight(n);
                 n->setBalance(-1);
                 child->setBalance(1);
@@ -530,6 +613,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
             //case 1c
             else if(child->getBalance() == 1){
                 AVLNode<Key, Value>* grandchild = child->getRight();
+                BST_STAT(++this->opStats_.doubleRotations;)
                 rotateLeft(child);
                 rotateRight(n);
 
@@ -567,6 +651,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
 
             //case 1a
             if(child->getBalance() == 1){
+                BST_STAT(++this->opStats_.singleRotations;)
                 rotateLeft(n);
                 n->setBalance(0);
                 child->setBalance(0);
@@ -575,6 +660,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
             }
             //case 1b
             else if(child->getBalance() == 0){
+                BST_STAT(++this->opStats_.singleRotations;)
                 rotateLeft(n);
                 n->setBalance(1);
                 child->setBalance(-1);
@@ -582,6 +668,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
             //case 1c
             else if(child->getBalance() == -1){
                 AVLNode<Key, Value>* grandchild = child->getLeft();
+                BST_STAT(++this->opStats_.doubleRotations;)
                 rotateRight(child);
                 rotateLeft(n);
 
@@ -614,6 +701,27 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff){
     }
 }
 
+/**
+* Recomputes whatever a subclass stores per node about the node's subtree,
+* from its own value and its children (which must be up to date). Called on
+* both nodes of every rotation, the lower one first. Nothing to do here.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::augmentNode(AVLNode<Key, Value>* n)
+{
+
+}
+
+/**
+* Recomputes n and then each of its ancestors up to the root, after n's
+* subtree gained or lost a node or n's value changed. Nothing to do here.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::augmentPath(AVLNode<Key, Value>* n)
+{
+
+}
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
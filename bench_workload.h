@@ -0,0 +1,172 @@
+#ifndef BENCH_WORKLOAD_H
+#define BENCH_WORKLOAD_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Key streams and container adapters shared by bst-bench and perf-check, so
+// both measure exactly the same work.
+
+#define ZIPF_THETA 0.99
+
+// the operations every benchmark row measures, in this order
+#define OPERATIONS 6
+static const char* const operationNames[OPERATIONS] = {"insert", "find_hit", "find_miss", "remove", "iterate", "clear"};
+
+/**
+* Bijective 64-bit mix (the splitmix64 finalizer): distinct ranks give
+* distinct, randomly ordered keys.
+*/
+inline uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+* Zipf-distributed ranks in [0, n), using the closed form of Gray et al.
+* (as in YCSB): O(n) setup, O(1) per sample, no tables.
+*/
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(uint64_t n, double theta, uint64_t seed) :
+        n_(n),
+        theta_(theta),
+        rng_(seed)
+    {
+        double zetan = 0;
+        for(uint64_t i = 1; i <= n; i++){
+            zetan += 1.0 / std::pow((double)i, theta);
+        }
+        double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        zetan_ = zetan;
+        eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    }
+
+    uint64_t next()
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng_);
+        double uz = u * zetan_;
+        if(uz < 1.0){
+            return 0;
+        }
+        if(uz < 1.0 + std::pow(0.5, theta_)){
+            return 1;
+        }
+        uint64_t rank = (uint64_t)(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return std::min(rank, n_ - 1);
+    }
+
+private:
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double zetan_;
+    double eta_;
+    std::mt19937_64 rng_;
+};
+
+/**
+* The key streams for one distribution and size. inserts is the insert (and
+* remove) order, hits are keys known to be present, misses keys known to be
+* absent.
+*/
+struct Workload
+{
+    std::string distribution;
+    std::vector<uint64_t> inserts;
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> misses;
+};
+
+/**
+* Builds the streams for "sorted", "reverse", "random" or "zipf" keys. The
+* result depends only on the arguments.
+*/
+inline Workload makeWorkload(const std::string& distribution, uint64_t n)
+{
+    Workload w;
+    w.distribution = distribution;
+    w.inserts.resize(n);
+    w.misses.resize(n);
+    std::mt19937_64 rng(n);
+
+    for(uint64_t i = 0; i < n; i++){
+        if(distribution == "sorted"){
+            w.inserts[i] = 2 * i;
+            w.misses[i] = 2 * i + 1;
+        }
+        else if(distribution == "reverse"){
+            w.inserts[i] = 2 * (n - 1 - i);
+            w.misses[i] = 2 * i + 1;
+        }
+        else{
+            w.misses[i] = mix(n + i);
+        }
+    }
+    if(distribution == "random"){
+        for(uint64_t i = 0; i < n; i++){
+            w.inserts[i] = mix(i);
+        }
+    }
+    else if(distribution == "zipf"){
+        // hot keys repeat, so the tree ends up with fewer than n entries
+        ZipfGenerator zipf(n, ZIPF_THETA, n);
+        for(uint64_t i = 0; i < n; i++){
+            w.inserts[i] = mix(zipf.next());
+        }
+    }
+
+    // look the keys up in a different order than they went in; for zipf the
+    // duplicates keep the lookups skewed towards the hot keys
+    w.hits = w.inserts;
+    std::shuffle(w.hits.begin(), w.hits.end(), rng);
+    std::shuffle(w.misses.begin(), w.misses.end(), rng);
+    return w;
+}
+
+// uniform operations over std::map and the trees
+
+inline void insertKey(std::map<uint64_t, uint64_t>& m, uint64_t key, uint64_t value)
+{
+    m[key] = value;
+}
+
+template<typename Tree>
+void insertKey(Tree& t, uint64_t key, uint64_t value)
+{
+    t.insert(std::make_pair(key, value));
+}
+
+inline bool contains(const std::map<uint64_t, uint64_t>& m, uint64_t key)
+{
+    return m.find(key) != m.end();
+}
+
+template<typename Tree>
+bool contains(const Tree& t, uint64_t key)
+{
+    return t.find(key) != t.end();
+}
+
+inline void removeKey(std::map<uint64_t, uint64_t>& m, uint64_t key)
+{
+    m.erase(key);
+}
+
+template<typename Tree>
+void removeKey(Tree& t, uint64_t key)
+{
+    t.remove(key);
+}
+
+#endif
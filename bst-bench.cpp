@@ -0,0 +1,249 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst_instances.h"
+#include "latency_histogram.h"
+#include "bench_workload.h"
+
+using namespace std;
+
+// Compares BinarySearchTree, AVLTree and std::map (the baseline) on insert,
+// find (hit and miss), remove, full iteration and clear, for sorted, reverse,
+// random and Zipf-distributed keys. Results go to stdout as JSON; progress
+// goes to stderr.
+//
+// Small sizes are repeated until about ROUND_OPS operations have run, so
+// every row measures a comparable amount of work.
+//
+// With --latency every single operation is also timed with CycleClock and
+// each row gets a "latency_ns" object with p50, p99, p99.9 and max, to catch
+// tail regressions (rotation cascades, long successor() walks) that averages
+// hide. Clear is timed as one operation per round. The per-operation clock
+// reads add a few ns to the throughput figures in this mode.
+//
+// usage: ./bst-bench [maxSize] [--latency]   (sizes are 1K, 10K, ... up to maxSize, default 10M)
+
+#define ROUND_OPS 2000000
+
+// sorted and reverse input turn the unbalanced tree into a list, so it is
+// only run on them up to this size
+#define DEGENERATE_LIMIT 10000
+
+/**
+* Accumulated time and operation count for one benchmark row, and the
+* per-operation latencies when they are recorded.
+*/
+struct Timing
+{
+    uint64_t ops;
+    double seconds;
+    LatencyHistogram latency;
+
+    Timing() : ops(0), seconds(0) { }
+};
+
+typedef chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+    chrono::duration<double> elapsed = Clock::now() - start;
+    return elapsed.count();
+}
+
+// keeps lookups and iteration from being optimized away
+volatile uint64_t sink;
+
+// per-operation clock reads, compiled out when Latency is false
+#define OP_START(Latency) ((Latency) ? CycleClock::now() : 0)
+#define OP_STOP(Latency, timing, opStart) if(Latency){ (timing).latency.record(CycleClock::now() - (opStart)); }
+
+/**
+* Runs every operation on a fresh container, rounds times, adding to timings.
+*/
+template<typename Container, bool Latency>
+void runRounds(const Workload& w, int rounds, Timing timings[OPERATIONS])
+{
+    for(int round = 0; round < rounds; round++){
+        Container c;
+        uint64_t checksum = 0;
+
+        Clock::time_point start = Clock::now();
+        for(size_t i = 0; i < w.inserts.size(); i++){
+            uint64_t opStart = OP_START(Latency);
+            insertKey(c, w.inserts[i], i);
+            OP_STOP(Latency, timings[0], opStart);
+        }
+        timings[0].seconds += secondsSince(start);
+        timings[0].ops += w.inserts.size();
+
+        start = Clock::now();
+        for(size_t i = 0; i < w.hits.size(); i++){
+            uint64_t opStart = OP_START(Latency);
+            checksum += contains(c, w.hits[i]);
+            OP_STOP(Latency, timings[1], opStart);
+        }
+        timings[1].seconds += secondsSince(start);
+        timings[1].ops += w.hits.size();
+
+        start = Clock::now();
+        for(size_t i = 0; i < w.misses.size(); i++){
+            uint64_t opStart = OP_START(Latency);
+            checksum += contains(c, w.misses[i]);
+            OP_STOP(Latency, timings[2], opStart);
+        }
+        timings[2].seconds += secondsSince(start);
+        timings[2].ops += w.misses.size();
+
+        start = Clock::now();
+        uint64_t entries = 0;
+        typename Container::iterator it = c.begin();
+        while(it != c.end()){
+            uint64_t opStart = OP_START(Latency);
+            checksum += it->second;
+            ++it;
+            OP_STOP(Latency, timings[4], opStart);
+            ++entries;
+        }
+        timings[4].seconds += secondsSince(start);
+        timings[4].ops += entries;
+
+        start = Clock::now();
+        for(size_t i = 0; i < w.inserts.size(); i++){
+            uint64_t opStart = OP_START(Latency);
+            removeKey(c, w.inserts[i]);
+            OP_STOP(Latency, timings[3], opStart);
+        }
+        timings[3].seconds += secondsSince(start);
+        timings[3].ops += w.inserts.size();
+
+        // clear needs a full container again; the refill is not timed
+        for(size_t i = 0; i < w.inserts.size(); i++){
+            insertKey(c, w.inserts[i], i);
+        }
+        start = Clock::now();
+        uint64_t opStart = OP_START(Latency);
+        c.clear();
+        OP_STOP(Latency, timings[5], opStart);
+        timings[5].seconds += secondsSince(start);
+        timings[5].ops += entries;
+
+        sink = checksum;
+    }
+}
+
+template<typename Container>
+void runStructure(const Workload& w, int rounds, bool latency, Timing timings[OPERATIONS])
+{
+    if(latency){
+        runRounds<Container, true>(w, rounds, timings);
+    }
+    else{
+        runRounds<Container, false>(w, rounds, timings);
+    }
+}
+
+/**
+* One JSON object per (structure, distribution, size, operation).
+*/
+void printRow(ostream& out, bool& first, const string& structure, const string& distribution,
+    uint64_t size, const char* operation, const Timing& timing, double baselineNs)
+{
+    double nsPerOp = timing.ops ? timing.seconds * 1e9 / timing.ops : 0;
+    out << (first ? "\n" : ",\n");
+    first = false;
+    out << "    {\"structure\": \"" << structure << "\", \"distribution\": \"" << distribution
+        << "\", \"size\": " << size << ", \"operation\": \"" << operation
+        << "\", \"ops\": " << timing.ops << ", \"seconds\": " << timing.seconds
+        << ", \"ns_per_op\": " << nsPerOp
+        << ", \"ops_per_sec\": " << (timing.seconds > 0 ? timing.ops / timing.seconds : 0)
+        << ", \"speedup_vs_std_map\": " << (nsPerOp > 0 ? baselineNs / nsPerOp : 0);
+
+    const LatencyHistogram& h = timing.latency;
+    if(h.count() > 0){
+        double nsPerTick = 1.0 / CycleClock::ticksPerNs();
+        out << ", \"latency_ns\": {\"samples\": " << h.count()
+            << ", \"p50\": " << h.percentile(0.50) * nsPerTick
+            << ", \"p99\": " << h.percentile(0.99) * nsPerTick
+            << ", \"p999\": " << h.percentile(0.999) * nsPerTick
+            << ", \"max\": " << h.max() * nsPerTick << "}";
+    }
+    out << "}";
+}
+
+void printSkipped(ostream& out, bool& first, const string& structure, const string& distribution, uint64_t size)
+{
+    out << (first ? "\n" : ",\n");
+    first = false;
+    out << "    {\"structure\": \"" << structure << "\", \"distribution\": \"" << distribution
+        << "\", \"size\": " << size << ", \"skipped\": \"degenerates to a list (O(n^2))\"}";
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t maxSize = 10000000;
+    bool latency = false;
+    for(int i = 1; i < argc; i++){
+        if(string(argv[i]) == "--latency"){
+            latency = true;
+        }
+        else{
+            maxSize = strtoull(argv[i], nullptr, 10);
+        }
+    }
+    if(maxSize < 1000){
+        cerr << "usage: " << argv[0] << " [maxSize >= 1000] [--latency]" << endl;
+        return 1;
+    }
+    if(latency){
+        CycleClock::ticksPerNs();
+    }
+
+    const char* distributions[] = {"sorted", "reverse", "random", "zipf"};
+    bool first = true;
+
+    cout << "{\n  \"benchmark\": \"bst-bench\",\n  \"baseline\": \"std::map\",\n  \"latency\": "
+         << (latency ? "true" : "false") << ",\n  \"results\": [";
+    for(uint64_t n = 1000; n <= maxSize; n *= 10){
+        int rounds = (int)max<uint64_t>(1, ROUND_OPS / n);
+        for(size_t d = 0; d < sizeof(distributions) / sizeof(distributions[0]); d++){
+            string distribution = distributions[d];
+            cerr << distribution << " n=" << n << endl;
+            Workload w = makeWorkload(distribution, n);
+
+            Timing baseline[OPERATIONS];
+            runStructure<map<uint64_t, uint64_t> >(w, rounds, latency, baseline);
+            double baselineNs[OPERATIONS];
+            for(int op = 0; op < OPERATIONS; op++){
+                baselineNs[op] = baseline[op].ops ? baseline[op].seconds * 1e9 / baseline[op].ops : 0;
+                printRow(cout, first, "std::map", distribution, n, operationNames[op], baseline[op], baselineNs[op]);
+            }
+
+            Timing avl[OPERATIONS];
+            runStructure<AVLTree<uint64_t, uint64_t> >(w, rounds, latency, avl);
+            for(int op = 0; op < OPERATIONS; op++){
+                printRow(cout, first, "AVLTree", distribution, n, operationNames[op], avl[op], baselineNs[op]);
+            }
+
+            bool ordered = distribution == "sorted" || distribution == "reverse";
+            if(ordered && n > DEGENERATE_LIMIT){
+                printSkipped(cout, first, "BinarySearchTree", distribution, n);
+                continue;
+            }
+            // a list already does O(n) work per operation, one round is plenty
+            Timing bst[OPERATIONS];
+            runStructure<BinarySearchTree<uint64_t, uint64_t> >(w, ordered ? 1 : rounds, latency, bst);
+            for(int op = 0; op < OPERATIONS; op++){
+                printRow(cout, first, "BinarySearchTree", distribution, n, operationNames[op], bst[op], baselineNs[op]);
+            }
+        }
+    }
+    cout << "\n  ]\n}" << endl;
+    return 0;
+}
@@ -0,0 +1,398 @@
+// the search and rebalance counters are what this fuzzer checks
+#ifndef BST_STATS
+#define BST_STATS
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Differential fuzzer for AVLTree and BinarySearchTree.
+//
+// Every input is decoded into a sequence of operations that runs against
+// both trees and a std::map. Besides the answers, each operation's cost is
+// read from the -DBST_STATS counters and checked:
+//   both trees        a search visits exactly the nodes on the path to its
+//                     key (for a missing key, to the deeper of its neighbours)
+//   AVLTree           that path is at most 1.44 * log2(n + 2) nodes, the
+//                     rebalance after an insert or remove walks at most that
+//                     many ancestors, and an insert rebalances at most once
+//                     (one single or double rotation)
+//   BinarySearchTree  nothing ever rotates
+// so a bug that leaves insertFix()/removeFix() correct but slow (a missed
+// rotation, a cascade that keeps climbing) fails here even though every
+// answer is right. The AVL height and balance are also checked directly.
+//
+// Input format, three bytes per operation: op, key high byte, key low byte.
+// Keys are taken modulo FUZZ_KEYS so operations collide often. op & 7 picks
+// the operation, op >> 3 its run length or scan length (1 to 32):
+//   0, 1  insert key                  5  insert key, key+1, ... (ascending run)
+//   2     remove key                  6  remove key, key+1, ... (ascending run)
+//   3     find key                    7  insert key, key-1, ... (descending run)
+//   4     find key, then ++ up to len steps
+//
+// Standalone (the Makefile build) it runs random inputs, or replays files:
+//   usage: ./bst-fuzz [runs [seed]]  |  ./bst-fuzz input-file...
+// A failure prints what was violated, saves the input to bst-fuzz-crash.bin
+// and aborts. Built with -DBST_FUZZ_LIBFUZZER it is a libFuzzer target
+// instead, e.g.
+//   clang++ -g -O1 -std=c++11 -fsanitize=fuzzer,address -DBST_FUZZ_LIBFUZZER bst-fuzz.cpp
+
+#define FUZZ_KEYS 1024
+#define FUZZ_MAX_INPUT 4096
+
+// Knuth's bound on AVL height: below 1.4405 * log2(n + 2) - 0.3277
+#define AVL_HEIGHT_FACTOR 1.4405
+
+// compare the whole tree with the map every this many operations
+#define FULL_CHECK_INTERVAL 64
+
+const uint8_t* currentInput;
+size_t currentSize;
+size_t currentOp;
+
+[[noreturn]] void fail(const string& tree, const string& message)
+{
+    cerr << "bst-fuzz: " << tree << ", operation " << currentOp << ": " << message << endl;
+#ifndef BST_FUZZ_LIBFUZZER
+    ofstream out("bst-fuzz-crash.bin", ios::binary);
+    out.write(reinterpret_cast<const char*>(currentInput), currentSize);
+    cerr << "bst-fuzz: input saved to bst-fuzz-crash.bin" << endl;
+#endif
+    abort();
+}
+
+uint64_t avlBound(size_t n)
+{
+    return (uint64_t)(AVL_HEIGHT_FACTOR * log2((double)n + 2));
+}
+
+/**
+* Exposes node depths and the height of the tree to the checks below.
+*/
+template<typename Tree>
+class ProbedTree : public Tree
+{
+public:
+    int height() const
+    {
+        return Tree::height(this->root_);
+    }
+
+    // nodes from the root down to key's node, 0 if it is not in the tree
+    uint64_t depth(uint64_t key) const
+    {
+        uint64_t d = 0;
+        for(auto n = this->findFrom(this->root_, key); n; n = n->getParent()){
+            ++d;
+        }
+        return d;
+    }
+};
+
+/**
+* One tree under test, its std::map reference and the cost checks.
+*/
+template<typename Tree>
+class DifferentialRun
+{
+public:
+    typedef typename Tree::OperationStats Stats;
+
+    DifferentialRun(const string& name, bool avl) :
+        name_(name),
+        avl_(avl)
+    {
+
+    }
+
+    void insert(uint64_t key, uint64_t value)
+    {
+        size_t n = tree_.size();
+        uint64_t path = pathLength(key);
+        Stats before = tree_.operationStats();
+        tree_.insert(make_pair(key, value));
+        reference_[key] = value;
+        Stats after = tree_.operationStats();
+
+        checkSearch("insert", key, before, after, path, n);
+        checkRebalance("insert", key, before, after);
+        if(avl_ && rebalances(before, after) > 1){
+            fail(name_, describe("insert", key) + " rebalanced " + to_string(rebalances(before, after)) +
+                " times; an AVL insert needs at most one rotation or double rotation");
+        }
+        checkSize("insert", key);
+    }
+
+    void remove(uint64_t key)
+    {
+        size_t n = tree_.size();
+        uint64_t path = pathLength(key);
+        Stats before = tree_.operationStats();
+        tree_.remove(key);
+        reference_.erase(key);
+        Stats after = tree_.operationStats();
+
+        checkSearch("remove", key, before, after, path, n);
+        checkRebalance("remove", key, before, after);
+        checkSize("remove", key);
+    }
+
+    void find(uint64_t key)
+    {
+        size_t n = tree_.size();
+        uint64_t path = pathLength(key);
+        Stats before = tree_.operationStats();
+        typename Tree::iterator it = tree_.find(key);
+        Stats after = tree_.operationStats();
+
+        map<uint64_t, uint64_t>::iterator expected = reference_.find(key);
+        if((it == tree_.end()) != (expected == reference_.end())){
+            fail(name_, describe("find", key) + (expected == reference_.end() ? " found a removed key" : " missed a present key"));
+        }
+        if(it != tree_.end() && (it->first != key || it->second != expected->second)){
+            fail(name_, describe("find", key) + " returned the wrong entry");
+        }
+        checkSearch("find", key, before, after, path, n);
+    }
+
+    void scan(uint64_t key, int steps)
+    {
+        typename Tree::iterator it = tree_.find(key);
+        map<uint64_t, uint64_t>::iterator expected = reference_.find(key);
+        for(int i = 0; i < steps && expected != reference_.end(); i++, ++it, ++expected){
+            if(it == tree_.end() || it->first != expected->first || it->second != expected->second){
+                fail(name_, describe("scan", key) + " differs from std::map after " + to_string(i) + " steps");
+            }
+        }
+        if(expected == reference_.end() && it != tree_.end()){
+            fail(name_, describe("scan", key) + " ran past the largest key");
+        }
+    }
+
+    /**
+    * Compares every entry with the map and checks the shape of the tree.
+    */
+    void checkAll()
+    {
+        typename Tree::iterator it = tree_.begin();
+        for(map<uint64_t, uint64_t>::iterator expected = reference_.begin(); expected != reference_.end(); ++expected, ++it){
+            if(it == tree_.end() || it->first != expected->first || it->second != expected->second){
+                fail(name_, "in-order contents differ from std::map at key " + to_string(expected->first));
+            }
+        }
+        if(it != tree_.end()){
+            fail(name_, "tree holds entries std::map does not");
+        }
+        if(avl_){
+            uint64_t height = tree_.height();
+            if(height > avlBound(tree_.size())){
+                fail(name_, "height " + to_string(height) + " with " + to_string(tree_.size()) +
+                    " nodes exceeds the AVL bound " + to_string(avlBound(tree_.size())));
+            }
+            if(!tree_.isBalanced()){
+                fail(name_, "tree is not balanced");
+            }
+        }
+    }
+
+private:
+    string describe(const string& op, uint64_t key) const
+    {
+        return op + "(" + to_string(key) + ") with " + to_string(tree_.size()) + " entries";
+    }
+
+    /**
+    * The nodes a search for key has to visit in the tree as it is now: the
+    * path to its node, or for a missing key the path to where it would be
+    * attached, below the deeper of its two neighbours.
+    */
+    uint64_t pathLength(uint64_t key) const
+    {
+        map<uint64_t, uint64_t>::const_iterator next = reference_.lower_bound(key);
+        if(next != reference_.end() && next->first == key){
+            return tree_.depth(key);
+        }
+        uint64_t length = next != reference_.end() ? tree_.depth(next->first) : 0;
+        if(next != reference_.begin()){
+            --next;
+            length = max(length, tree_.depth(next->first));
+        }
+        return length;
+    }
+
+    static uint64_t rebalances(const Stats& before, const Stats& after)
+    {
+        return after.singleRotations + after.doubleRotations - before.singleRotations - before.doubleRotations;
+    }
+
+    // the longest cascade recorded between the two snapshots
+    static uint64_t longestCascade(const Stats& before, const Stats& after)
+    {
+        for(int i = BST_STATS_BUCKETS - 1; i > 0; i--){
+            if(after.cascadeHistogram[i] != before.cascadeHistogram[i]){
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // n is the size of the tree the search ran on
+    void checkSearch(const string& op, uint64_t key, const Stats& before, const Stats& after, uint64_t path, size_t n)
+    {
+        uint64_t visited = after.nodesVisited - before.nodesVisited;
+        if(visited != path){
+            fail(name_, describe(op, key) + " visited " + to_string(visited) +
+                " nodes, the path to the key is " + to_string(path));
+        }
+        if(avl_ && path > avlBound(n)){
+            fail(name_, describe(op, key) + " searched a path of " + to_string(path) +
+                " nodes, more than the AVL bound " + to_string(avlBound(n)) + " (1.44 * log2(n + 2))");
+        }
+    }
+
+    void checkRebalance(const string& op, uint64_t key, const Stats& before, const Stats& after)
+    {
+        uint64_t rotations = after.rotateLefts + after.rotateRights - before.rotateLefts - before.rotateRights;
+        if(!avl_){
+            if(rotations != 0){
+                fail(name_, describe(op, key) + " rotated an unbalanced tree");
+            }
+            return;
+        }
+        uint64_t cascade = longestCascade(before, after);
+        uint64_t bound = avlBound(max(tree_.size(), reference_.size()) + 1);
+        if(cascade > bound){
+            fail(name_, describe(op, key) + " rebalanced " + to_string(cascade) +
+                " ancestors, more than the height bound " + to_string(bound));
+        }
+    }
+
+    void checkSize(const string& op, uint64_t key)
+    {
+        if(tree_.size() != reference_.size()){
+            fail(name_, describe(op, key) + ": size() is " + to_string(tree_.size()) +
+                ", std::map holds " + to_string(reference_.size()));
+        }
+    }
+
+    string name_;
+    bool avl_;
+    ProbedTree<Tree> tree_;
+    map<uint64_t, uint64_t> reference_;
+};
+
+/**
+* Decodes one input and runs it on a tree.
+*/
+template<typename Tree>
+void runInput(DifferentialRun<Tree>& run, const uint8_t* data, size_t size)
+{
+    for(size_t i = 0; i + 3 <= size; i += 3){
+        currentOp = i / 3;
+        uint8_t op = data[i];
+        uint64_t key = ((uint64_t)data[i + 1] << 8 | data[i + 2]) % FUZZ_KEYS;
+        int length = (op >> 3) + 1;
+        switch(op & 7){
+            case 0: case 1:
+                run.insert(key, currentOp);
+                break;
+            case 2:
+                run.remove(key);
+                break;
+            case 3:
+                run.find(key);
+                break;
+            case 4:
+                run.scan(key, length);
+                break;
+            case 5:
+                for(int j = 0; j < length; j++){
+                    run.insert(key + j, currentOp);
+                }
+                break;
+            case 6:
+                for(int j = 0; j < length; j++){
+                    run.remove(key + j);
+                }
+                break;
+            default:
+                for(int j = 0; j < length && j <= (int)key; j++){
+                    run.insert(key - j, currentOp);
+                }
+                break;
+        }
+        if(currentOp % FULL_CHECK_INTERVAL == FULL_CHECK_INTERVAL - 1){
+            run.checkAll();
+        }
+    }
+    run.checkAll();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    currentInput = data;
+    currentSize = size;
+
+    DifferentialRun<AVLTree<uint64_t, uint64_t> > avl("AVLTree", true);
+    runInput(avl, data, size);
+    DifferentialRun<BinarySearchTree<uint64_t, uint64_t> > bst("BinarySearchTree", false);
+    runInput(bst, data, size);
+    return 0;
+}
+
+#ifndef BST_FUZZ_LIBFUZZER
+bool parseCount(const char* text, uint64_t& value)
+{
+    char* end = nullptr;
+    value = strtoull(text, &end, 10);
+    return *text && !*end;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t runs = 1000;
+    uint64_t seed = 1;
+    if(argc > 1 && !parseCount(argv[1], runs)){
+        //replay saved inputs
+        for(int i = 1; i < argc; i++){
+            ifstream in(argv[i], ios::binary);
+            if(!in){
+                cerr << "cannot read " << argv[i] << endl;
+                return 1;
+            }
+            string input((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+            cout << argv[i] << ": ok" << endl;
+        }
+        return 0;
+    }
+    if(argc > 2 && !parseCount(argv[2], seed)){
+        cerr << "usage: " << argv[0] << " [runs [seed]] | " << argv[0] << " input-file..." << endl;
+        return 1;
+    }
+
+    mt19937_64 rng(seed);
+    vector<uint8_t> input;
+    for(uint64_t run = 0; run < runs; run++){
+        input.resize(rng() % (FUZZ_MAX_INPUT + 1));
+        for(size_t i = 0; i < input.size(); i++){
+            input[i] = (uint8_t)rng();
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    cout << "bst-fuzz: " << runs << " inputs passed (seed " << seed << ")" << endl;
+    return 0;
+}
+#endif
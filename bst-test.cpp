@@ -49,7 +49,7 @@ int main(int argc, char *argv[])
     t.insert(make_pair(2,2));
     t.insert(make_pair(3,3));
 
-    t.printRoot();
+    t.print();
 
     return 0;
 }
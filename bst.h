@@ -5,6 +5,60 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "leaf_depth_profile.h"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Operation counters and depth histograms (see BinarySearchTree::OperationStats).
+// They are compiled in only with -DBST_STATS; otherwise BST_STAT() expands to
+// nothing, the trees carry no counter members and operationStats() reads zeros.
+#ifdef BST_STATS
+#define BST_STAT(statement) statement
+#else
+#define BST_STAT(statement)
+#endif
+
+// histogram buckets; deeper searches and longer cascades land in the last one
+#define BST_STATS_BUCKETS 64
+
+/**
+* Process-wide heap figures, shared by every tree (see processHeapStats()).
+*/
+struct HeapStats
+{
+    size_t inUse;           // heap bytes handed out
+    size_t free;            // heap bytes held but free
+    double fragmentation;   // free / (inUse + free)
+};
+
+/**
+* Reads the process heap figures; zero where the allocator cannot report
+* them. On glibc this is mallinfo2(), which walks every arena's bins under
+* their locks, so call it once per scrape rather than once per tree.
+*/
+inline HeapStats processHeapStats()
+{
+    HeapStats stats;
+    stats.inUse = 0;
+    stats.free = 0;
+    stats.fragmentation = 0.0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 heap = mallinfo2();
+    stats.inUse = heap.uordblks + heap.hblkhd;
+    stats.free = heap.fordblks;
+    if(stats.inUse + stats.free > 0){
+        stats.fragmentation = (double)stats.free / (stats.inUse + stats.free);
+    }
+#endif
+    return stats;
+}
 
 /**
  * A templated class for a Node in a search tree.
@@ -201,6 +255,87 @@ public:
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    size_t size() const;
+
+    /**
+    * Hit/miss counters for the optional lookup cache.
+    */
+    struct LookupCacheStats
+    {
+        size_t slots;
+        uint64_t hits;
+        uint64_t misses;
+    };
+    // find() and operator[] write to the cache even though they are const, so
+    // a tree with the cache on must not be searched from several threads at once
+    void enableLookupCache(size_t numSlots);
+    void disableLookupCache();
+    LookupCacheStats lookupCacheStats() const;
+
+    /**
+    * Memory used by one tree: the nodes and the lookup cache. Memory a Key or
+    * Value owns on the heap (e.g. string contents) is not included. For the
+    * process heap as a whole see processHeapStats().
+    */
+    struct MemoryStats
+    {
+        size_t nodes;
+        size_t nodeBytes;           // nodes * sizeof(node), links and balance included
+        size_t payloadBytes;        // nodes * sizeof(std::pair<const Key, Value>)
+        size_t allocatedBytes;      // what the allocator really reserves for the nodes
+        size_t allocatorOverhead;   // allocatedBytes - nodeBytes: chunk headers and size-class rounding
+        size_t cacheBytes;          // lookup cache slots
+    };
+    MemoryStats memoryStats() const;
+
+    // leaf count, min/max leaf depth and leaf depth histogram in one pass
+    // (see leaf_depth_profile.h)
+    LeafDepthProfile leafDepthProfile() const;
+
+    /**
+    * Counters kept when built with -DBST_STATS. A search is one descent from
+    * the root or a finger (find, insert and remove each do one). A cascade is
+    * the number of ancestors an AVL insertFix()/removeFix() walked up for one
+    * update, so cascadeHistogram[0] counts updates that needed no fix at all.
+    */
+    struct OperationStats
+    {
+        uint64_t finds;
+        uint64_t inserts;
+        uint64_t removes;
+        uint64_t comparisons;       // key comparisons made while searching
+        uint64_t nodesVisited;      // nodes searches passed through
+        uint64_t rotateLefts;
+        uint64_t rotateRights;
+        uint64_t singleRotations;   // AVL rebalances fixed by one rotation
+        uint64_t doubleRotations;   // AVL rebalances that needed two
+        uint64_t depthHistogram[BST_STATS_BUCKETS];     // nodes visited per search
+        uint64_t cascadeHistogram[BST_STATS_BUCKETS];   // ancestors visited per rebalance
+    };
+    OperationStats operationStats() const;
+    void resetOperationStats();
+
+    void save(std::ostream& out) const;
+    void load(std::istream& in);
+    void saveVarint(std::ostream& out, uint32_t blockEntries = 1024) const;
+    void loadVarint(std::istream& in);
+
+    /**
+    * What exportDot()/exportJson() write. Limits of 0 mean no limit. A
+    * subtree that is left out is written as a "cut" stub under its parent.
+    */
+    struct ExportOptions
+    {
+        bool values;            // write each node's value next to its key
+        int maxDepth;           // deepest level written, the root being depth 1
+        uint64_t maxNodes;      // stop after this many nodes
+        int sampleDepth;        // level whose subtrees are sampled
+        uint64_t sampleEvery;   // keep only every sampleEvery-th subtree at sampleDepth
+
+        ExportOptions() : values(true), maxDepth(0), maxNodes(0), sampleDepth(0), sampleEvery(1) { }
+    };
+    void exportDot(std::ostream& out, const ExportOptions& options = ExportOptions()) const;
+    void exportJson(std::ostream& out, const ExportOptions& options = ExportOptions()) const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
@@ -227,19 +362,112 @@ public:
         Node<Key, Value> *current_;
     };
 
+    /**
+    * Visits each node before its subtrees, left subtree first. Steps with
+    * parent pointers, so it holds nothing but the current node.
+    */
+    class preorder_iterator : public iterator
+    {
+    public:
+        preorder_iterator();
+        preorder_iterator& operator++();
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        preorder_iterator(Node<Key,Value>* ptr);
+    };
+
+    /**
+    * Visits each node after both its subtrees, so a node's children always
+    * come before it. Steps with parent pointers, like preorder_iterator.
+    */
+    class postorder_iterator : public iterator
+    {
+    public:
+        postorder_iterator();
+        postorder_iterator& operator++();
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        postorder_iterator(Node<Key,Value>* ptr);
+    };
+
+    /**
+    * Visits the nodes level by level from the root, left to right within a
+    * level. Holds the rest of the current level and the part of the next one
+    * found so far in two buffers that are swapped at each level, so it
+    * allocates only while the levels grow wider; copying one copies them.
+    */
+    class level_iterator : public iterator
+    {
+    public:
+        level_iterator();
+        level_iterator& operator++();
+
+        // depth of the current node, the root being 1
+        int depth() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        level_iterator(Node<Key,Value>* ptr);
+
+        std::vector<Node<Key, Value>*> level_;
+        std::vector<Node<Key, Value>*> next_;
+        size_t position_;
+        int depth_;
+    };
+
 public:
     iterator begin() const;
     iterator end() const;
+    preorder_iterator preorder_begin() const;
+    preorder_iterator preorder_end() const;
+    postorder_iterator postorder_begin() const;
+    postorder_iterator postorder_end() const;
+    level_iterator level_begin() const;
+    level_iterator level_end() const;
     iterator find(const Key& key) const;
+    iterator find(iterator finger, const Key& key) const;
+    iterator lower_bound(iterator finger, const Key& key) const;
+    iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    template<typename... Args>
+    iterator emplace_hint(iterator hint, Args&&... args);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* findFrom(Node<Key, Value>* start, const Key& key) const;
+    Node<Key, Value>* fingerStart(Node<Key, Value>* finger, const Key& key, Node<Key, Value>*& bound) const;
+    size_t cacheSlot(const Key& key) const;
+    void uncacheNode(Node<Key, Value>* n);
+    static size_t stdHash(const Key& key);
+#ifdef BST_STATS
+    void recordSearch(uint64_t depth, uint64_t comparisons) const;
+    void recordCascade(uint64_t length) const;
+#endif
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* searchParent(const Key& key, Node<Key, Value>*& parent) const;
+    Node<Key, Value>* hintedSearch(Node<Key, Value>* hint, const Key& key, Node<Key, Value>*& parent) const;
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* parent, const std::pair<const Key, Value>& keyValuePair);
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void setBuiltBalance(Node<Key, Value>* n, int8_t balance);
+    virtual bool storedBalance(const Node<Key, Value>* n, int8_t& balance) const;
+    virtual void valueChanged(Node<Key, Value>* n);
+    virtual size_t nodeSize() const;
+    static iterator iteratorAt(Node<Key, Value>* n);
+    template<typename Visitor>
+    void exportWalk(Visitor& visitor, const ExportOptions& options) const;
+    template<typename Source>
+    void buildFrom(Source& source, uint64_t count);
+    template<typename Source>
+    Node<Key, Value>* buildSubtree(Source& source, uint64_t count, Node<Key, Value>*& last, int& height);
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     static Node<Key, Value>* successor(Node<Key, Value>* curent);// TODO
+    static Node<Key, Value>* preorderNext(Node<Key, Value>* current);
+    static Node<Key, Value>* postorderFirst(Node<Key, Value>* root);
+    static Node<Key, Value>* postorderNext(Node<Key, Value>* current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
@@ -254,6 +482,27 @@ protected:
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+
+    // largest node, kept so hinted appends at end() do not have to walk the right spine
+    Node<Key, Value>* rightmost_;
+
+    // number of nodes, so size() and memoryStats() do not walk the tree
+    size_t size_;
+
+    // allocator chunk size of one node, measured by the first memoryStats() (0 until then)
+    mutable size_t chunkBytes_;
+
+    // optional direct-mapped key->node cache in front of internalFind() (empty when disabled)
+    mutable std::vector<Node<Key, Value>*> cache_;
+    size_t (*cacheHash_)(const Key&);
+    mutable uint64_t cacheHits_;
+    mutable uint64_t cacheMisses_;
+
+#ifdef BST_STATS
+    mutable OperationStats opStats_;
+    // ancestors visited by the rebalance in progress
+    uint64_t cascade_;
+#endif
 };
 
 /*
@@ -359,6 +608,105 @@ BinarySearchTree<Key, Value>::iterator::operator++()
 }
 
 
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::preorder_iterator::preorder_iterator(Node<Key,Value> *ptr) :
+    iterator(ptr)
+{
+
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::preorder_iterator::preorder_iterator()
+{
+
+}
+
+/**
+* Advances to the next node in pre-order (see preorderNext()).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::preorder_iterator&
+BinarySearchTree<Key, Value>::preorder_iterator::operator++()
+{
+    this->current_ = preorderNext(this->current_);
+    return *this;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::postorder_iterator::postorder_iterator(Node<Key,Value> *ptr) :
+    iterator(ptr)
+{
+
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::postorder_iterator::postorder_iterator()
+{
+
+}
+
+/**
+* Advances to the next node in post-order (see postorderNext()).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::postorder_iterator&
+BinarySearchTree<Key, Value>::postorder_iterator::operator++()
+{
+    this->current_ = postorderNext(this->current_);
+    return *this;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::level_iterator::level_iterator(Node<Key,Value> *ptr) :
+    iterator(ptr), position_(0), depth_(ptr ? 1 : 0)
+{
+    if(ptr){
+        level_.push_back(ptr);
+    }
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::level_iterator::level_iterator() :
+    position_(0), depth_(0)
+{
+
+}
+
+/**
+* Queues the children of the current node for the next level and moves on,
+* to the start of the next level once this one is done.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::level_iterator&
+BinarySearchTree<Key, Value>::level_iterator::operator++()
+{
+    if(!this->current_){
+        return *this;
+    }
+    if(this->current_->getLeft()){
+        next_.push_back(this->current_->getLeft());
+    }
+    if(this->current_->getRight()){
+        next_.push_back(this->current_->getRight());
+    }
+
+    if(++position_ == level_.size()){
+        //both buffers keep their capacity for the levels to come
+        level_.swap(next_);
+        next_.clear();
+        position_ = 0;
+        ++depth_;
+    }
+    this->current_ = position_ < level_.size() ? level_[position_] : nullptr;
+    return *this;
+}
+
+template<class Key, class Value>
+int BinarySearchTree<Key, Value>::level_iterator::depth() const
+{
+    return depth_;
+}
+
 /*
 -------------------------------------------------------------
 End implementations for the BinarySearchTree::iterator class.
@@ -378,6 +726,13 @@ template<class Key, class Value>
 BinarySearchTree<Key, Value>::BinarySearchTree() 
 {
     root_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    chunkBytes_ = 0;
+    cacheHash_ = nullptr;
+    cacheHits_ = 0;
+    cacheMisses_ = 0;
+    resetOperationStats();
 }
 
 template<typename Key, typename Value>
@@ -396,6 +751,12 @@ bool BinarySearchTree<Key, Value>::empty() const
     return root_ == NULL;
 }
 
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return size_;
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::print() const
 {
@@ -425,6 +786,52 @@ BinarySearchTree<Key, Value>::end() const
     return end;
 }
 
+/**
+* Pre-order, post-order and level-order traversals of the whole tree. Each
+* pair compares equal to its end (and to end()) when the traversal is done.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::preorder_iterator
+BinarySearchTree<Key, Value>::preorder_begin() const
+{
+    return preorder_iterator(root_);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::preorder_iterator
+BinarySearchTree<Key, Value>::preorder_end() const
+{
+    return preorder_iterator(nullptr);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::postorder_iterator
+BinarySearchTree<Key, Value>::postorder_begin() const
+{
+    return postorder_iterator(postorderFirst(root_));
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::postorder_iterator
+BinarySearchTree<Key, Value>::postorder_end() const
+{
+    return postorder_iterator(nullptr);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::level_iterator
+BinarySearchTree<Key, Value>::level_begin() const
+{
+    return level_iterator(root_);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::level_iterator
+BinarySearchTree<Key, Value>::level_end() const
+{
+    return level_iterator(nullptr);
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
@@ -438,6 +845,52 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
     return it;
 }
 
+/**
+* Finger search: like find(key), but starts from finger (an iterator from an
+* earlier lookup) instead of the root. It climbs only until it reaches a
+* subtree that must contain key and then descends, so the cost is O(log d)
+* where d is the rank distance between finger and key. An end() finger
+* searches from the root.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(iterator finger, const Key& key) const
+{
+    Node<Key, Value>* bound = nullptr;
+    Node<Key, Value>* start = fingerStart(finger.current_, key, bound);
+    BST_STAT(++opStats_.finds;)
+    BinarySearchTree<Key, Value>::iterator it(findFrom(start, key));
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* searching from finger like find(finger, key). Unlike find() it is still a
+* useful finger for the next probe when key is missing.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lower_bound(iterator finger, const Key& key) const
+{
+    Node<Key, Value>* bound = nullptr;
+    Node<Key, Value>* current = fingerStart(finger.current_, key, bound);
+
+    //bound is the smallest node seen so far that is greater than key
+    while(current){
+        if(key < current->getKey()){
+            bound = current;
+            current = current->getLeft();
+        }
+        else if(key > current->getKey()){
+            current = current->getRight();
+        }
+        else{
+            return iterator(current);
+        }
+    }
+    return iterator(bound);
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -466,82 +919,162 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 template<class Key, class Value>
 void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-
-    Node<Key, Value>* n = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-    if(!root_){
-        root_ = n;
+    Node<Key, Value>* parent = nullptr;
+    BST_STAT(++opStats_.inserts;)
+    Node<Key, Value>* match = searchParent(keyValuePair.first, parent);
+
+    //if the key is already in the tree, overwrite its value
+    if(match){
+        match->setValue(keyValuePair.second);
+        valueChanged(match);
         return;
     }
+    attachNode(parent, keyValuePair);
+}
+
+/**
+* Inserts using hint as a guess for where the key belongs. If the key sorts
+* right next to hint (just before it, or just after it) the node is spliced in
+* without a descent from the root; otherwise this falls back to a normal insert.
+* Passing end() as the hint is the cheap way to append a new largest key.
+* Returns an iterator to the inserted (or overwritten) item.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value> &keyValuePair)
+{
+    Node<Key, Value>* parent = nullptr;
+    BST_STAT(++opStats_.inserts;)
+    Node<Key, Value>* match = hintedSearch(hint.current_, keyValuePair.first, parent);
+
+    if(match){
+        match->setValue(keyValuePair.second);
+        valueChanged(match);
+        return iterator(match);
+    }
+    return iterator(attachNode(parent, keyValuePair));
+}
+
+/**
+* Builds the item from args and inserts it using hint, see insert(hint, pair).
+*/
+template<class Key, class Value>
+template<typename... Args>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::emplace_hint(iterator hint, Args&&... args)
+{
+    std::pair<const Key, Value> item(std::forward<Args>(args)...);
+    return insert(hint, item);
+}
 
+/**
+* Descends from the root looking for key. Returns the node holding key if there
+* is one; otherwise returns NULL and sets parent to the node the new key would
+* hang off of (NULL for an empty tree).
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::searchParent(const Key& key, Node<Key, Value>*& parent) const
+{
+    parent = nullptr;
     Node<Key, Value>* current = root_;
+    BST_STAT(uint64_t depth = 0; uint64_t comparisons = 0;)
 
-    while(1){
-        if(n->getKey() < current->getKey()){
-            if(!current->getLeft()){
-                current->setLeft(n);
-                n->setParent(current);
-                return;
-            }
+    while(current){
+        BST_STAT(++depth; ++comparisons;)
+        if(key < current->getKey()){
+            parent = current;
             current = current->getLeft();
         }
-        else if(n->getKey() > current->getKey()){
-            if(!current->getRight()){
-                current->setRight(n);
-                n->setParent(current);
-                return;
-            }
+        else if(key > current->getKey()){
+            BST_STAT(++comparisons;)
+            parent = current;
             current = current->getRight();
         }
         else{
-            current->setValue(n->getValue());
-            delete n;
-            return;
+            BST_STAT(++comparisons; recordSearch(depth, comparisons);)
+            return current;
+        }
+    }
+    BST_STAT(recordSearch(depth, comparisons);)
+    return nullptr;
+}
+
+/**
+* Same contract as searchParent(), but first tries the gap just before hint and
+* then the gap just after it (hint == NULL means end()). Only if key fits in
+* neither gap do we pay for a descent from the root.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::hintedSearch(Node<Key, Value>* hint, const Key& key, Node<Key, Value>*& parent) const
+{
+    parent = nullptr;
+    if(!root_){
+        return nullptr;
+    }
+
+    //start with the gap between the hint's predecessor and the hint
+    Node<Key, Value>* before = hint ? predecessor(hint) : rightmost_;
+    Node<Key, Value>* after = hint;
+
+    //if the key sorts after the hint, use the gap between the hint and its successor
+    if(hint && !(key < hint->getKey())){
+        if(!(key > hint->getKey())){
+            return hint;
         }
+        before = hint;
+        after = (hint == rightmost_) ? nullptr : successor(hint);
     }
 
-    // //if the tree is empty, insert a new node at the root
-    // if(!root_){
-    //     root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-    //     return;
-    // }
-
-    // //traverse the tree until we find a left or right child that is empty
-    // Node<Key, Value>* current = root_;
-    // while(1){
-    //     //if the key is less than currents key, go left
-    //     if(keyValuePair.first < current->getKey()){
-
-    //         //if there is a left child, go to the left child
-    //         if(current->getLeft()){
-    //             current = current->getLeft();
-    //         }
-    //         //if there is no left child, insert a new node to the left
-    //         else{
-    //             current->setLeft(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, current));
-    //             current->getLeft()->setParent(current);
-    //             return;
-    //         }
-    //     }
-    //     //if the key is greater than currents key, go right
-    //     else if(keyValuePair.first > current->getKey()){
-
-    //         //if there is a right child, then go to the right child
-    //         if(current->getRight()){
-    //             current = current->getRight();
-    //         }
-    //         //if there is no right child, then insert a new node to the right
-    //         else{
-    //             current->setRight(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, current));
-    //             current->getRight()->setParent(current);
-    //             return;
-    //         }
-    //     }
-    //     //if the key is equal, then replace the data that was previously stored at this key
-    //     else{
-    //         current->setValue(keyValuePair.second);
-    //         return;
-    //     }
-    // }
+    //the key has to be strictly between before and after, otherwise the hint was wrong
+    if(before && !(key > before->getKey())){
+        if(!(key < before->getKey())){
+            return before;
+        }
+        return searchParent(key, parent);
+    }
+    if(after && !(key < after->getKey())){
+        if(!(key > after->getKey())){
+            return after;
+        }
+        return searchParent(key, parent);
+    }
+
+    //before and after are neighbours, so either before has no right child
+    //or after has no left child, and that empty slot is where the key goes
+    if(before && !before->getRight()){
+        parent = before;
+    }
+    else{
+        parent = after;
+    }
+    return nullptr;
+}
+
+/**
+* Creates a node for keyValuePair and links it under parent (or as the root if
+* parent is NULL). The caller guarantees the matching child slot is empty.
+* Returns the new node.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::attachNode(Node<Key, Value>* parent, const std::pair<const Key, Value>& keyValuePair)
+{
+    Node<Key, Value>* n = createNode(keyValuePair.first, keyValuePair.second, parent);
+    ++size_;
+
+    if(!parent){
+        root_ = n;
+        rightmost_ = n;
+    }
+    else if(n->getKey() < parent->getKey()){
+        parent->setLeft(n);
+    }
+    else{
+        parent->setRight(n);
+        if(parent == rightmost_){
+            rightmost_ = n;
+        }
+    }
+    return n;
 }
 
 
@@ -555,13 +1088,16 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
     //traverse to find node with key
     Node<Key, Value>* temp = root_;
+    BST_STAT(++opStats_.removes; uint64_t depth = 0; uint64_t comparisons = 0;)
 
     //traverse until we find the node
     while(1){
         //key was not found
         if(!temp){
+            BST_STAT(recordSearch(depth, comparisons);)
             return;
         }
+        BST_STAT(++depth; ++comparisons;)
 
         //if the key is less than temp, go left
         if(key < temp->getKey()){
@@ -569,19 +1105,29 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         }
         //if the key is greater than temp, go right
         else if(key > temp->getKey()){
+            BST_STAT(++comparisons;)
             temp = temp->getRight();
         }
         //if we found the key, stop traversing and break out of loop
         else{
+            BST_STAT(++comparisons;)
             break;
         }
     }
+    BST_STAT(recordSearch(depth, comparisons);)
+    uncacheNode(temp);
+    --size_;
 
     //if there are two children, then swap with its predecessor
     if(temp->getRight() && temp->getLeft()){
         nodeSwap(predecessor(temp), temp);
     }
 
+    //if we are removing the largest node, its predecessor becomes the largest
+    if(temp == rightmost_){
+        rightmost_ = predecessor(temp);
+    }
+
     //now that there are less than 2 children
     //if there are no children
     if(!temp->getRight() && !temp->getLeft()){
@@ -694,6 +1240,64 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* curr
 }
 
 
+/**
+* The node after current in pre-order, or nullptr after the last one: its
+* first child if it has one, else the right child of the nearest ancestor
+* whose left subtree current is in and that has one.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::preorderNext(Node<Key, Value>* current){
+    if(!current){
+        return nullptr;
+    }
+    if(current->getLeft()){
+        return current->getLeft();
+    }
+    if(current->getRight()){
+        return current->getRight();
+    }
+
+    Node<Key, Value>* parent = current->getParent();
+    while(parent && (parent->getRight() == current || !parent->getRight())){
+        current = parent;
+        parent = parent->getParent();
+    }
+    return parent ? parent->getRight() : nullptr;
+}
+
+/**
+* The first node of root's subtree in post-order: the leaf reached by going
+* left whenever possible and right otherwise.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::postorderFirst(Node<Key, Value>* root){
+    if(!root){
+        return nullptr;
+    }
+    while(root->getLeft() || root->getRight()){
+        root = root->getLeft() ? root->getLeft() : root->getRight();
+    }
+    return root;
+}
+
+/**
+* The node after current in post-order, or nullptr after the root. Only
+* looks at current, its parent and the parent's right subtree, none of which
+* post-order has passed yet, so deleteTree() can free nodes behind it.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::postorderNext(Node<Key, Value>* current){
+    if(!current){
+        return nullptr;
+    }
+    Node<Key, Value>* parent = current->getParent();
+    //from a left child, the right sibling's subtree comes before the parent
+    if(parent && parent->getRight() && parent->getRight() != current){
+        return postorderFirst(parent->getRight());
+    }
+    return parent;
+}
+
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
@@ -703,6 +1307,9 @@ void BinarySearchTree<Key, Value>::clear()
 {
     deleteTree(root_);
     root_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    cache_.assign(cache_.size(), nullptr);
 }
 
 template<typename Key, typename Value>
@@ -711,10 +1318,15 @@ void BinarySearchTree<Key, Value>::deleteTree(Node<Key, Value>* root){
         return;
     }
 
-    //delete left subtree
-    deleteTree(root->getLeft());
-    //delete right subtree
-    deleteTree(root->getRight());
+    //post-order, so each node goes after its children; the next node is
+    //found before the current one is deleted, and no stack is needed even
+    //for a degenerate tree
+    Node<Key, Value>* current = postorderFirst(root);
+    while(current != root){
+        Node<Key, Value>* next = postorderNext(current);
+        delete current;
+        current = next;
+    }
     delete root;
 }
 
@@ -743,28 +1355,331 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
 */
 template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+{
+    BST_STAT(++opStats_.finds;)
+    if(cache_.empty()){
+        return findFrom(root_, key);
+    }
+
+    //check the cache before paying for a descent
+    size_t slot = cacheSlot(key);
+    Node<Key, Value>* cached = cache_[slot];
+    if(cached && !(key < cached->getKey()) && !(key > cached->getKey())){
+        ++cacheHits_;
+        return cached;
+    }
+
+    ++cacheMisses_;
+    Node<Key, Value>* found = findFrom(root_, key);
+    if(found){
+        cache_[slot] = found;
+    }
+    return found;
+}
+
+/**
+* Allocates a node of the kind this tree uses. Overridden by trees with
+* their own node types (e.g. AVLTree) so shared code can create nodes.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return new Node<Key, Value>(key, value, parent);
+}
+
+/**
+* Size of one node, so memoryStats() can account for subclasses' node types.
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::nodeSize() const
+{
+    return sizeof(Node<Key, Value>);
+}
+
+/**
+* Records the balance (right height - left height) of a node made by a bulk
+* build. Plain nodes do not store a balance, so there is nothing to do.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::setBuiltBalance(Node<Key, Value>* n, int8_t balance)
+{
+
+}
+
+/**
+* Called after insert() overwrites the value of an existing node, so trees
+* that keep per-node data derived from values can refresh it. Nothing to do
+* here.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::valueChanged(Node<Key, Value>* n)
+{
+
+}
+
+/**
+* An iterator positioned at n, for derived trees that find nodes themselves
+* (the iterator's own node constructor is not open to them).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* n)
+{
+    return iterator(n);
+}
+
+/**
+* Reads the balance stored in a node, for the exporters. Plain nodes do not
+* store one, so this returns false.
+*/
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::storedBalance(const Node<Key, Value>* n, int8_t& balance) const
+{
+    return false;
+}
+
+/**
+* Turns on a direct-mapped lookup cache of numSlots entries (rounded up to a
+* power of two) that find() and operator[] check before descending the tree.
+* Requires std::hash<Key>. Calling it again resizes the cache and resets the
+* counters.
+*
+* Not thread-safe: with the cache on, every find() and operator[] (const ones
+* included) stores into a slot and bumps the hit/miss counters, both mutable.
+* Concurrent lookups on one tree are then a data race, so a tree read from
+* several threads must keep the cache off or serialize its lookups.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::enableLookupCache(size_t numSlots)
+{
+    size_t slots = 1;
+    while(slots < numSlots){
+        slots *= 2;
+    }
+    //a fresh vector, so shrinking the cache gives its memory back
+    std::vector<Node<Key, Value>*>(slots, nullptr).swap(cache_);
+    cacheHash_ = &stdHash;
+    cacheHits_ = 0;
+    cacheMisses_ = 0;
+}
+
+/**
+* Turns the lookup cache off and frees it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::disableLookupCache()
+{
+    std::vector<Node<Key, Value>*>().swap(cache_);
+    cacheHash_ = nullptr;
+}
+
+/**
+* Returns the cache size and the hit/miss counts since it was enabled.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::LookupCacheStats
+BinarySearchTree<Key, Value>::lookupCacheStats() const
+{
+    LookupCacheStats stats;
+    stats.slots = cache_.size();
+    stats.hits = cacheHits_;
+    stats.misses = cacheMisses_;
+    return stats;
+}
+
+/**
+* Reports how much memory the tree uses, in O(1) and without locking the
+* heap, so it can be polled often. All nodes have the same size, so the
+* allocator's real chunk size is measured once, on the first call, with a
+* probe allocation of that size: on glibc malloc_usable_size() plus the chunk
+* header. Elsewhere allocatedBytes equals nodeBytes.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::MemoryStats
+BinarySearchTree<Key, Value>::memoryStats() const
+{
+    size_t nodeBytes = nodeSize();
+    if(chunkBytes_ == 0){
+        chunkBytes_ = nodeBytes;
+#ifdef __GLIBC__
+        void* probe = std::malloc(nodeBytes);
+        if(probe){
+            chunkBytes_ = malloc_usable_size(probe) + sizeof(size_t);
+            std::free(probe);
+        }
+#endif
+    }
+
+    MemoryStats stats;
+    stats.nodes = size_;
+    stats.nodeBytes = size_ * nodeBytes;
+    stats.payloadBytes = size_ * sizeof(std::pair<const Key, Value>);
+    stats.allocatedBytes = size_ * chunkBytes_;
+    stats.allocatorOverhead = stats.allocatedBytes - stats.nodeBytes;
+    stats.cacheBytes = cache_.capacity() * sizeof(Node<Key, Value>*);
+    return stats;
+}
+
+/**
+* Profiles the shape of the tree in one O(n) walk: its height is maxDepth,
+* and it has equal paths exactly when minDepth == maxDepth.
+*/
+template<typename Key, typename Value>
+LeafDepthProfile BinarySearchTree<Key, Value>::leafDepthProfile() const
+{
+    return ::leafDepthProfile(root_);
+}
+
+/**
+* Returns the operation counters. Without -DBST_STATS nothing is counted and
+* every field is zero.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::OperationStats
+BinarySearchTree<Key, Value>::operationStats() const
+{
+#ifdef BST_STATS
+    return opStats_;
+#else
+    OperationStats stats;
+    std::memset(&stats, 0, sizeof(stats));
+    return stats;
+#endif
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetOperationStats()
+{
+#ifdef BST_STATS
+    std::memset(&opStats_, 0, sizeof(opStats_));
+    cascade_ = 0;
+#endif
+}
+
+#ifdef BST_STATS
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::recordSearch(uint64_t depth, uint64_t comparisons) const
+{
+    opStats_.nodesVisited += depth;
+    opStats_.comparisons += comparisons;
+    ++opStats_.depthHistogram[std::min<uint64_t>(depth, BST_STATS_BUCKETS - 1)];
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::recordCascade(uint64_t length) const
+{
+    ++opStats_.cascadeHistogram[std::min<uint64_t>(length, BST_STATS_BUCKETS - 1)];
+}
+#endif
+
+/**
+* Maps a key to its cache slot. std::hash is the identity for integers, so the
+* hash is scrambled (Fibonacci hashing) to spread clustered keys.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::cacheSlot(const Key& key) const
+{
+    uint64_t h = (uint64_t)cacheHash_(key) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h ^ (h >> 32)) & (cache_.size() - 1);
+}
+
+/**
+* Drops n from the cache, must be called before a node is deleted. A node is
+* only ever cached in its own key's slot, so that is the only slot to check.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::uncacheNode(Node<Key, Value>* n)
+{
+    if(cache_.empty()){
+        return;
+    }
+    size_t slot = cacheSlot(n->getKey());
+    if(cache_[slot] == n){
+        cache_[slot] = nullptr;
+    }
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::stdHash(const Key& key)
+{
+    return std::hash<Key>()(key);
+}
+
+/**
+* Helper function to find a node with given key in the subtree rooted at start.
+* Returns NULL if no item in that subtree has that key.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::findFrom(Node<Key, Value>* start, const Key& key) const
 {
     //traverse the tree
-    Node<Key, Value>* temp = root_;
+    Node<Key, Value>* temp = start;
+    BST_STAT(uint64_t depth = 0; uint64_t comparisons = 0;)
 
     //while temp is not null
     while(temp){
+        BST_STAT(++depth; ++comparisons;)
         //if the key is less than temps key, go to the left child
         if(key < temp->getKey()){
             temp = temp->getLeft();
         }
         //if the key is greater than temps key, go to the right child
         else if(key > temp->getKey()){
+            BST_STAT(++comparisons;)
             temp = temp->getRight();
         }
         //if we found the key, break
         else{
+            BST_STAT(++comparisons;)
             break;
         }
     }
+    BST_STAT(recordSearch(depth, comparisons);)
     return temp;
 }
 
+/**
+* Climbs from finger to the lowest ancestor whose subtree must contain key
+* (if key is in the tree at all) and returns it as the place to start
+* descending. Only ancestors reached from the side facing key need a key
+* comparison. bound is set to the nearest ancestor known to be greater than
+* key when there is one, so lower_bound() can fall back to it.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::fingerStart(Node<Key, Value>* finger, const Key& key, Node<Key, Value>*& bound) const
+{
+    bound = nullptr;
+    if(!finger){
+        return root_;
+    }
+
+    Node<Key, Value>* current = finger;
+
+    //key is to the right of the finger: climb until we come up out of a left subtree
+    //into a parent that is not smaller than key
+    if(key > finger->getKey()){
+        while(current->getParent()){
+            Node<Key, Value>* parent = current->getParent();
+            if(parent->getLeft() == current && !(parent->getKey() < key)){
+                bound = parent;
+                return key < parent->getKey() ? current : parent;
+            }
+            current = parent;
+        }
+    }
+    //key is to the left of the finger: climb until we come up out of a right subtree
+    //into a parent that is not larger than key
+    else if(key < finger->getKey()){
+        while(current->getParent()){
+            Node<Key, Value>* parent = current->getParent();
+            if(parent->getRight() == current && !(parent->getKey() > key)){
+                return key > parent->getKey() ? current : parent;
+            }
+            current = parent;
+        }
+    }
+    return current;
+}
+
 /**
  * Return true iff the BST is balanced.
  */
@@ -816,6 +1731,10 @@ int BinarySearchTree<Key, Value>::height(Node<Key, Value>* root) const{
 
 
 
+/**
+* Swaps the positions of two nodes. The nodes keep their items, so any
+* key->node pointers in the lookup cache stay valid.
+*/
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
@@ -914,6 +1833,15 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 // include print function (in its own file because it's fairly long)
 #include "print_bst.h"
 
+// include snapshot save/load (binary format and serializers)
+#include "snapshot_bst.h"
+
+// include delta/varint compressed export for integer keys
+#include "varint_bst.h"
+
+// include streaming Graphviz/JSON export
+#include "export_bst.h"
+
 /*
 ---------------------------------------------------
 End implementations for the BinarySearchTree class.
@@ -0,0 +1,7 @@
+#include "bst_instances.h"
+
+// The one copy of the trees declared extern in bst_instances.h.
+template class Node<uint64_t, uint64_t>;
+template class AVLNode<uint64_t, uint64_t>;
+template class BinarySearchTree<uint64_t, uint64_t>;
+template class AVLTree<uint64_t, uint64_t>;
@@ -0,0 +1,24 @@
+#ifndef BST_INSTANCES_H
+#define BST_INSTANCES_H
+
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+
+// The uint64_t -> uint64_t trees the benchmarks use.
+//
+// The release and PGO builds (see the Makefile) compile them once, in
+// bst_instances.cpp, and build every program with -DBST_EXTERN_INSTANCES so
+// none of them instantiates its own copy. All programs then run the same
+// tree code, and the profile pgo-train records for bst_instances.o applies
+// to all of them; -flto still inlines it across the object boundary.
+// Without BST_EXTERN_INSTANCES this header only includes the trees.
+
+#ifdef BST_EXTERN_INSTANCES
+extern template class Node<uint64_t, uint64_t>;
+extern template class AVLNode<uint64_t, uint64_t>;
+extern template class BinarySearchTree<uint64_t, uint64_t>;
+extern template class AVLTree<uint64_t, uint64_t>;
+#endif
+
+#endif
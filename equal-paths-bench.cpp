@@ -0,0 +1,354 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <algorithm>
+#include "equal-paths.h"
+#include "equal-paths-parallel.h"
+
+using namespace std;
+
+// Times equalPaths() on generated trees:
+//   perfect        every leaf at the same depth (wide; a full walk, true)
+//   random         random shape, each subtree split at a uniform size
+//                  (almost always false, after an unknown part of the tree,
+//                  so no nodes/s)
+//   chain          one child per node, alternating sides (deep; true)
+// next to the previous recursive implementation, which walks both subtrees
+// completely before it looks at either result and recurses once per level.
+// It is skipped on chains deeper than RECURSIVE_LIMIT, where it would
+// overflow the stack.
+//
+// Then it shows the early exit on the largest perfect tree: one leaf at a
+// time is made one level deeper ("almost equal", false), from the leftmost
+// leaf to the rightmost. "scanned" is how many nodes the walk visits before
+// it returns, which the pool's pre-order layout gives exactly.
+//
+// With --scaling it times parallelEqualPaths() instead, for 1, 2, 4, ...
+// threads up to twice the hardware threads, on a perfect tree of about
+// maxNodes nodes and on the same tree with its rightmost leaf pushed one
+// level deeper (false, but only at the very end of a sequential walk).
+//
+// Every tree is built in one contiguous pool of maxNodes + 1 nodes, in the
+// order equalPaths() visits them; 10^8 nodes take about 2.4 GB.
+//
+// usage: ./equal-paths-bench [maxNodes] [--scaling]   (default 4M, 1e8 works)
+
+#define RECURSIVE_LIMIT 10000
+
+// each measurement is repeated until it has run this long
+#define MIN_SECONDS 0.2
+
+/**
+* The previous implementation, kept as the reference.
+*/
+int recursivePath(Node* root)
+{
+    if(root == nullptr){
+        return 0;
+    }
+    int left = recursivePath(root->left);
+    int right = recursivePath(root->right);
+    if(left == -1 || right == -1){
+        return -1;
+    }
+    if(root->right == nullptr && root->left != nullptr){
+        return left + 1;
+    }
+    else if(root->right != nullptr && root->left == nullptr){
+        return right + 1;
+    }
+    return right == left ? left + 1 : -1;
+}
+
+bool recursiveEqualPaths(Node* root)
+{
+    return recursivePath(root) != -1;
+}
+
+/**
+* Nodes in one reserved block, so no tree costs an allocation per node and
+* a walk in allocation order reads memory sequentially. clear() drops the
+* current tree and keeps the block.
+*/
+class NodePool
+{
+public:
+    explicit NodePool(uint64_t capacity)
+    {
+        nodes_.reserve(capacity);
+    }
+
+    Node* make(int key)
+    {
+        //growing would move every node the trees point to
+        if(nodes_.size() == nodes_.capacity()){
+            throw length_error("node pool is full");
+        }
+        nodes_.push_back(Node(key));
+        return &nodes_.back();
+    }
+
+    // position of n in allocation order
+    uint64_t index(const Node* n) const
+    {
+        return n - nodes_.data();
+    }
+
+    void clear()
+    {
+        nodes_.clear();
+    }
+
+private:
+    vector<Node> nodes_;
+};
+
+Node* perfect(NodePool& pool, int height, int& key)
+{
+    if(height == 0){
+        return nullptr;
+    }
+    Node* n = pool.make(key++);
+    n->left = perfect(pool, height - 1, key);
+    n->right = perfect(pool, height - 1, key);
+    return n;
+}
+
+Node* chain(NodePool& pool, uint64_t n)
+{
+    Node* root = pool.make(0);
+    Node* last = root;
+    for(uint64_t i = 1; i < n; i++){
+        Node* next = pool.make((int)i);
+        if(i % 2){
+            last->left = next;
+        }
+        else{
+            last->right = next;
+        }
+        last = next;
+    }
+    return root;
+}
+
+/**
+* A tree of n nodes whose left subtree at every node gets a uniformly random
+* share of the rest. The expected depth is O(log n), but the build keeps its
+* own stack anyway.
+*/
+Node* randomTree(NodePool& pool, uint64_t n, mt19937_64& rng)
+{
+    Node* root = nullptr;
+    vector<pair<Node**, uint64_t> > pending;
+    pending.push_back(make_pair(&root, n));
+    while(!pending.empty()){
+        Node** slot = pending.back().first;
+        uint64_t size = pending.back().second;
+        pending.pop_back();
+        if(size == 0){
+            continue;
+        }
+        Node* node = pool.make((int)pending.size());
+        *slot = node;
+        uint64_t leftSize = uniform_int_distribution<uint64_t>(0, size - 1)(rng);
+        //left on top, so nodes are laid out in the order the walk visits them
+        pending.push_back(make_pair(&node->right, size - 1 - leftSize));
+        pending.push_back(make_pair(&node->left, leftSize));
+    }
+    return root;
+}
+
+/**
+* Leaf number leaf (counting from the left) of a perfect tree of the given
+* height.
+*/
+Node* perfectLeaf(Node* root, int height, uint64_t leaf)
+{
+    Node* n = root;
+    for(int bit = height - 2; bit >= 0; bit--){
+        n = (leaf >> bit) & 1 ? n->right : n->left;
+    }
+    return n;
+}
+
+typedef chrono::steady_clock Clock;
+
+/**
+* Seconds per call of check on root, and its answer.
+*/
+double timeCheck(bool (*check)(Node*), Node* root, bool& result)
+{
+    uint64_t calls = 0;
+    chrono::duration<double> elapsed(0);
+    Clock::time_point start = Clock::now();
+    do{
+        result = check(root);
+        ++calls;
+        elapsed = Clock::now() - start;
+    } while(elapsed.count() < MIN_SECONDS);
+    return elapsed.count() / calls;
+}
+
+void run(const string& name, Node* root, uint64_t nodes, bool recursive)
+{
+    bool result = false;
+    double iterative = timeCheck(equalPaths, root, result);
+    cout << setw(14) << name << setw(12) << nodes << setw(8) << (result ? "true" : "false")
+         << setw(14) << fixed << setprecision(3) << iterative * 1e3;
+    //a false answer may have come from any part of the tree
+    if(result){
+        cout << setw(16) << setprecision(0) << nodes / iterative;
+    }
+    else{
+        cout << setw(16) << "-";
+    }
+
+    if(recursive){
+        bool expected = false;
+        double reference = timeCheck(recursiveEqualPaths, root, expected);
+        cout << setw(14) << setprecision(3) << reference * 1e3
+             << setw(12) << setprecision(1) << reference / iterative << "x";
+        if(expected != result){
+            cout << "  MISMATCH";
+        }
+    }
+    else{
+        cout << setw(14) << "-" << setw(13) << "-";
+    }
+    cout << endl;
+}
+
+/**
+* Makes each chosen leaf of a perfect tree one level deeper in turn (by
+* hanging extra under it) and times how soon equalPaths() gives up.
+*/
+void earlyExit(const NodePool& pool, Node* root, int height, Node* extra)
+{
+    uint64_t nodes = ((uint64_t)1 << height) - 1;
+    uint64_t leaves = (uint64_t)1 << (height - 1);
+    bool result = false;
+    double full = timeCheck(equalPaths, root, result);
+
+    cout << endl << "early exit, perfect tree of " << nodes << " nodes, one leaf one level deeper:" << endl;
+    cout << setw(14) << "deeper leaf" << setw(12) << "scanned" << setw(8) << "result"
+         << setw(14) << "ms" << setw(16) << "scanned/s" << setw(14) << "of full walk" << endl;
+
+    uint64_t positions[] = {0, 1, leaves / 1000, leaves / 100, leaves / 10, leaves / 2, leaves - 1};
+    for(size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++){
+        uint64_t position = positions[i];
+        if(i > 0 && position <= positions[i - 1]){
+            continue;
+        }
+        Node* leaf = perfectLeaf(root, height, position);
+        leaf->left = extra;
+        double seconds = timeCheck(equalPaths, root, result);
+        leaf->left = nullptr;
+
+        //the walk stops at the deeper leaf, now an inner node at the depth of
+        //the first leaf; if it is the first leaf, at the second leaf
+        Node* stop = position == 0 ? perfectLeaf(root, height, 1) : leaf;
+        uint64_t scanned = pool.index(stop) + 1 + (position == 0 ? 1 : 0);
+        cout << setw(14) << position << setw(12) << scanned << setw(8) << (result ? "true" : "false")
+             << setw(14) << fixed << setprecision(4) << seconds * 1e3
+             << setw(16) << setprecision(0) << scanned / seconds
+             << setw(13) << setprecision(2) << 100 * seconds / full << "%" << endl;
+    }
+}
+
+unsigned parallelThreads;
+
+bool parallelWithThreads(Node* root)
+{
+    return parallelEqualPaths(root, parallelThreads);
+}
+
+void scaling(const string& name, Node* root, uint64_t nodes)
+{
+    unsigned hardware = max(1u, thread::hardware_concurrency());
+    double single = 0;
+    for(parallelThreads = 1; parallelThreads <= 2 * hardware; parallelThreads *= 2){
+        bool result = false;
+        double seconds = timeCheck(parallelWithThreads, root, result);
+        if(parallelThreads == 1){
+            single = seconds;
+        }
+        cout << setw(14) << name << setw(12) << nodes << setw(8) << (result ? "true" : "false")
+             << setw(9) << parallelThreads << setw(14) << fixed << setprecision(3) << seconds * 1e3
+             << setw(16) << setprecision(0) << nodes / seconds
+             << setw(10) << setprecision(2) << single / seconds << "x" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t maxNodes = 1 << 22;
+    bool parallel = false;
+    for(int i = 1; i < argc; i++){
+        if(string(argv[i]) == "--scaling"){
+            parallel = true;
+        }
+        else{
+            //strtod, so 1e8 can be written as such
+            maxNodes = (uint64_t)strtod(argv[i], nullptr);
+        }
+    }
+    if(maxNodes < 1000 || maxNodes > INT32_MAX){
+        cerr << "usage: " << argv[0] << " [1000 <= maxNodes < 2^31] [--scaling]" << endl;
+        return 1;
+    }
+
+    NodePool pool(maxNodes + 1);
+    //largest perfect tree that fits, with room for one extra leaf
+    int maxHeight = 1;
+    while(((uint64_t)2 << maxHeight) - 1 <= maxNodes){
+        ++maxHeight;
+    }
+
+    if(parallel){
+        cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+        cout << setw(14) << "tree" << setw(12) << "nodes" << setw(8) << "result" << setw(9) << "threads"
+             << setw(14) << "ms" << setw(16) << "nodes/s" << setw(11) << "speedup" << endl;
+        int key = 0;
+        Node* root = perfect(pool, maxHeight, key);
+        scaling("perfect", root, ((uint64_t)1 << maxHeight) - 1);
+
+        Node* leaf = perfectLeaf(root, maxHeight, ((uint64_t)1 << (maxHeight - 1)) - 1);
+        leaf->right = pool.make(key++);
+        scaling("right-mismatch", root, (uint64_t)1 << maxHeight);
+        return 0;
+    }
+
+    cout << setw(14) << "tree" << setw(12) << "nodes" << setw(8) << "result"
+         << setw(14) << "iter ms" << setw(16) << "iter nodes/s"
+         << setw(14) << "recur ms" << setw(13) << "speedup" << endl;
+
+    for(int height = 10; height <= maxHeight; height += 4){
+        int key = 0;
+        pool.clear();
+        run("perfect", perfect(pool, height, key), ((uint64_t)1 << height) - 1, true);
+    }
+
+    mt19937_64 rng(1);
+    for(uint64_t n = 1000; n <= maxNodes; n *= 10){
+        pool.clear();
+        run("random", randomTree(pool, n, rng), n, true);
+    }
+
+    for(uint64_t n = 1000; n <= maxNodes; n *= 10){
+        pool.clear();
+        run("chain", chain(pool, n), n, n <= RECURSIVE_LIMIT);
+    }
+
+    int key = 0;
+    pool.clear();
+    Node* root = perfect(pool, maxHeight, key);
+    earlyExit(pool, root, maxHeight, pool.make(key++));
+    return 0;
+}
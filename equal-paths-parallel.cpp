@@ -0,0 +1,183 @@
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include "equal-paths-parallel.h"
+
+using namespace std;
+
+// Aim for this many subtrees per thread, so a thread that drew small
+// subtrees can take more while the others finish large ones.
+#define TASKS_PER_THREAD 16
+
+// Stop splitting this deep even if there are too few subtrees (chains).
+#define MAX_SPLIT_DEPTH 48
+
+// With fewer subtrees than this after the split (a chain) no threads are
+// started.
+#define MIN_PARALLEL_TASKS 2
+
+namespace {
+
+/**
+* State shared by the threads. expectedDepth is 0 until the first leaf is
+* found and never changes after that; cancelled is set by the first thread
+* that finds a mismatch.
+*/
+struct SharedCheck
+{
+    vector<pair<Node*, int> > tasks;
+    atomic<size_t> nextTask;
+    atomic<int> expectedDepth;
+    atomic<bool> cancelled;
+
+    SharedCheck() : nextTask(0), expectedDepth(0), cancelled(false) { }
+
+    /**
+    * Checks a leaf depth against the expected one, setting it if this is
+    * the first leaf. Returns the expected depth, which is what the caller
+    * compares the rest of its leaves against.
+    */
+    int leaf(int depth)
+    {
+        int expected = 0;
+        if(expectedDepth.compare_exchange_strong(expected, depth)){
+            return depth;
+        }
+        if(expected != depth){
+            cancelled.store(true, memory_order_relaxed);
+        }
+        return expected;
+    }
+};
+
+/**
+* The walk of equalPaths() on one subtree whose root is at depth, against
+* the shared expected depth. Returns early once any thread has cancelled.
+*/
+void walkSubtree(Node* root, int depth, SharedCheck& shared, vector<pair<Node*, int> >& pending)
+{
+    int leafDepth = shared.expectedDepth.load(memory_order_relaxed);
+    size_t bottom = pending.size();
+    Node* current = root;
+
+    while(true){
+        while(current->left != nullptr || current->right != nullptr){
+            //every leaf below an inner node this deep is too deep
+            if(leafDepth != 0 && depth >= leafDepth){
+                shared.cancelled.store(true, memory_order_relaxed);
+                return;
+            }
+            Node* next = current->left;
+            if(next == nullptr){
+                next = current->right;
+            }
+            else if(current->right != nullptr){
+                pending.push_back(make_pair(current->right, depth + 1));
+            }
+            current = next;
+            ++depth;
+        }
+
+        if(leafDepth == 0 || depth != leafDepth){
+            leafDepth = shared.leaf(depth);
+        }
+        //one relaxed load per leaf; the flag only ever goes from false to true
+        if(shared.cancelled.load(memory_order_relaxed)){
+            return;
+        }
+
+        if(pending.size() == bottom){
+            return;
+        }
+        current = pending.back().first;
+        depth = pending.back().second;
+        pending.pop_back();
+    }
+}
+
+void worker(SharedCheck* shared)
+{
+    vector<pair<Node*, int> > pending;
+    pending.reserve(64);
+    while(!shared->cancelled.load(memory_order_relaxed)){
+        size_t task = shared->nextTask.fetch_add(1);
+        if(task >= shared->tasks.size()){
+            return;
+        }
+        walkSubtree(shared->tasks[task].first, shared->tasks[task].second, *shared, pending);
+    }
+}
+
+/**
+* Expands the top of the tree level by level until there are enough subtrees
+* for the threads, checking the leaves met on the way. Returns false if
+* those leaves already show a mismatch.
+*/
+bool splitTop(Node* root, size_t wanted, SharedCheck& shared)
+{
+    vector<pair<Node*, int> >& level = shared.tasks;
+    level.push_back(make_pair(root, 1));
+
+    for(int depth = 1; level.size() < wanted && depth < MAX_SPLIT_DEPTH && !level.empty(); depth++){
+        vector<pair<Node*, int> > next;
+        for(size_t i = 0; i < level.size(); i++){
+            Node* n = level[i].first;
+            if(n->left == nullptr && n->right == nullptr){
+                shared.leaf(depth);
+                continue;
+            }
+            int expected = shared.expectedDepth.load(memory_order_relaxed);
+            if(expected != 0 && depth >= expected){
+                shared.cancelled.store(true, memory_order_relaxed);
+            }
+            if(n->left != nullptr){
+                next.push_back(make_pair(n->left, depth + 1));
+            }
+            if(n->right != nullptr){
+                next.push_back(make_pair(n->right, depth + 1));
+            }
+        }
+        if(shared.cancelled.load(memory_order_relaxed)){
+            return false;
+        }
+        level.swap(next);
+    }
+    return true;
+}
+
+}
+
+bool parallelEqualPaths(Node * root, unsigned threads)
+{
+    if(root == nullptr){
+        return true;
+    }
+    if(threads == 0){
+        threads = thread::hardware_concurrency();
+    }
+    if(threads <= 1){
+        return equalPaths(root);
+    }
+
+    SharedCheck shared;
+    if(!splitTop(root, (size_t)threads * TASKS_PER_THREAD, shared)){
+        return false;
+    }
+    if(shared.tasks.size() < MIN_PARALLEL_TASKS){
+        //a chain: at most one subtree, nothing to share out
+        worker(&shared);
+        return !shared.cancelled.load();
+    }
+
+    //the calling thread is one of the workers
+    vector<thread> helpers;
+    for(unsigned i = 1; i < threads && i < shared.tasks.size(); i++){
+        helpers.push_back(thread(worker, &shared));
+    }
+    worker(&shared);
+    for(size_t i = 0; i < helpers.size(); i++){
+        helpers[i].join();
+    }
+    return !shared.cancelled.load();
+}
@@ -0,0 +1,20 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+
+#include "equal-paths.h"
+
+/**
+ * @brief Same answer as equalPaths(), computed by several threads.
+ *
+ *        The top levels of the tree are split into subtrees that the threads
+ *        take from a shared list. The first leaf any thread reaches fixes the
+ *        expected depth for all of them, and the first mismatch stops every
+ *        thread. Deep, narrow trees (chains) give few subtrees and run close
+ *        to single-threaded.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of threads; 0 uses std::thread::hardware_concurrency()
+ */
+bool parallelEqualPaths(Node * root, unsigned threads = 0);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
-
+#include <vector>
+#include <utility>
 #endif
 
 #include "equal-paths.h"
@@ -9,70 +10,66 @@ using namespace std;
 
 // You may add any prototypes of helper functions here
 
-int calculatePath(Node* root){
-    // if(root == nullptr){
-    //     return 0;
-    // }
-
-    // int left = calculatePath(root->left);
-    // int right = calculatePath(root->right);
-
-    // if(left == -1 || right == -1 || left != right){
-    //     return -1;
-    // }
+// a right subtree still to be walked, and the depth of its root
+struct PendingSubtree {
+    Node* node;
+    int depth;
+};
 
-    // return left + 1;
 
+bool equalPaths(Node * root)
+{
     if(root == nullptr){
-        return 0;
+        return true;
     }
 
-    int left = calculatePath(root->left);
-    int right = calculatePath(root->right);
-
-    //if the left or right subtree height is different, return -1
-    //to signal that not all paths are equal
-    if(left == -1 || right == -1){
-        return -1;
-    }
+    //depth-first walk with an explicit stack, so a chain millions of nodes
+    //deep cannot overflow the call stack. It goes down left children first
+    //and only pushes right children that still have to be walked; the stack
+    //is indexed by hand because push_back/pop_back cost more than the walk.
+    vector<PendingSubtree> pending(64);
+    size_t top = 0;
+    //depth of the first leaf; 0 until one is found, as depths start at 1
+    int leafDepth = 0;
+    Node* current = root;
+    int depth = 1;
+
+    while(true){
+        //go down to the next leaf
+        while(current->left != nullptr || current->right != nullptr){
+            //every leaf below an inner node this deep is deeper than the first one
+            if(depth == leafDepth){
+                return false;
+            }
+            Node* next = current->left;
+            if(next == nullptr){
+                next = current->right;
+            }
+            else if(current->right != nullptr){
+                if(top == pending.size()){
+                    pending.resize(2 * top);
+                }
+                pending[top].node = current->right;
+                pending[top].depth = depth + 1;
+                ++top;
+            }
+            current = next;
+            ++depth;
+        }
 
-    //only left child exists
-    if(root->right == nullptr && root->left != nullptr){
-        return left + 1;
-    }
-    //only right child exists
-    else if(root->right != nullptr && root->left == nullptr){
-        return right + 1;
-    }
-    //both children exist or neither children exist
-    else{
-        if(right == left){
-            return left + 1;
+        //stop at the first leaf whose depth differs from the first leaf seen
+        if(leafDepth == 0){
+            leafDepth = depth;
         }
-        //signal that the left and right height is different
-        else{
-            return -1;
+        else if(depth != leafDepth){
+            return false;
         }
-    }
-}
-
 
-bool equalPaths(Node * root)
-{
-    // Add your code below
-    return calculatePath(root) != -1;
-
-
-    // VOODOO
-    // if(root->left == nullptr && root->right == nullptr){
-    //     return true;
-    // }
-    // else if(root->left != nullptr && root->right != nullptr){
-    //     bool left = equalPaths(root->left);
-    //     bool right = equalPaths(root->right);
-    //     return left == right;
-    // }
-    // else{
-    //     return false;
-    // }
+        if(top == 0){
+            return true;
+        }
+        --top;
+        current = pending[top].node;
+        depth = pending[top].depth;
+    }
 }
@@ -0,0 +1,374 @@
+#include <cmath>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+
+#ifndef EXPORT_BST_H
+#define EXPORT_BST_H
+
+// Streaming tree export: BinarySearchTree::exportDot() / exportJson()
+//
+// Both write the nodes in one iterative pre-order walk, straight to the
+// stream. Nodes are numbered in the order they are written, so a node's id
+// is all the writers need to remember about it, and the walk keeps one
+// pending entry per level: memory is O(height) however large the tree.
+//
+// Per node: id, parent id, side (left/right child), depth (root = 1), key,
+// the value if ExportOptions::values, and the stored AVL balance (right
+// height - left height) for AVL trees. Subtrees dropped by the maxDepth,
+// maxNodes or sampling limits are written as one "cut" stub each, so the
+// output shows where the tree goes on.
+//
+// DOT (for Graphviz):
+//   digraph bst {
+//     n0 [label="5: five\nd=1 b=0"];
+//     n0 -> n1;
+//     c1L [label="...", shape=plaintext];
+//     n1 -> c1L [style=dashed];
+//   }
+//
+// JSON: {"nodes":[...], "exported":N, "cut":M} where each array element is
+//   {"id":0,"parent":null,"side":"root","depth":1,"key":5,"value":"five","balance":0}
+// or, for a cut subtree,
+//   {"cut":true,"parent":1,"side":"left","depth":3}
+// Arithmetic keys and values are written as numbers, anything else as a
+// string built with operator<<.
+
+#define EXPORT_BST_NO_PARENT UINT64_MAX
+
+/**
+* Stream buffer that escapes every character for a JSON string or DOT label
+* and passes it on, so keys and values of any type can be written with their
+* own operator<< without building a string first.
+*/
+class ExportEscapeBuffer : public std::streambuf
+{
+public:
+    explicit ExportEscapeBuffer(std::ostream& out) : out_(out) { }
+
+    static void put(std::ostream& out, unsigned char c)
+    {
+        if(c == '"' || c == '\\'){
+            out << '\\' << c;
+        }
+        else if(c == '\n'){
+            out << "\\n";
+        }
+        else if(c < 0x20){
+            //other control characters only as JSON escapes
+            static const char hex[] = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        }
+        else{
+            out << c;
+        }
+    }
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        if(!traits_type::eq_int_type(c, traits_type::eof())){
+            put(out_, (unsigned char)traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::ostream& out_;
+};
+
+/**
+* Writes x for a JSON document or a DOT label: numbers as they are, strings
+* and everything else through operator<<, escaped (and quoted for JSON).
+*/
+struct ExportText
+{
+    template<typename T>
+    static void escaped(std::ostream& out, const T& x)
+    {
+        ExportEscapeBuffer buffer(out);
+        std::ostream escaping(&buffer);
+        escaping.flags(out.flags());
+        escaping.precision(out.precision());
+        escaping << x;
+    }
+
+    static void escaped(std::ostream& out, const std::string& x)
+    {
+        for(size_t i = 0; i < x.size(); i++){
+            ExportEscapeBuffer::put(out, x[i]);
+        }
+    }
+
+    template<typename T>
+    static void quoted(std::ostream& out, const T& x)
+    {
+        out << '"';
+        escaped(out, x);
+        out << '"';
+    }
+
+    // JSON has no inf or nan, so those become strings
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type json(std::ostream& out, const T& x)
+    {
+        if(std::isfinite(x)){
+            out << x;
+        }
+        else{
+            quoted(out, x);
+        }
+    }
+
+    // unary + so that int8_t/uint8_t come out as numbers, not characters
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type json(std::ostream& out, const T& x)
+    {
+        out << +x;
+    }
+
+    static void json(std::ostream& out, bool x)
+    {
+        out << (x ? "true" : "false");
+    }
+
+    static void json(std::ostream& out, char x)
+    {
+        quoted(out, std::string(1, x));
+    }
+
+    template<typename T>
+    static typename std::enable_if<!std::is_arithmetic<T>::value>::type json(std::ostream& out, const T& x)
+    {
+        quoted(out, x);
+    }
+
+    // DOT labels are always strings
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type label(std::ostream& out, const T& x)
+    {
+        out << +x;
+    }
+
+    template<typename T>
+    static typename std::enable_if<!std::is_integral<T>::value>::type label(std::ostream& out, const T& x)
+    {
+        escaped(out, x);
+    }
+};
+
+/**
+* exportWalk() visitor that writes Graphviz DOT.
+*/
+template<typename Key, typename Value>
+class DotTreeWriter
+{
+public:
+    DotTreeWriter(std::ostream& out, bool values) : out_(out), values_(values) { }
+
+    void begin()
+    {
+        out_ << "digraph bst {\n"
+             << "  node [shape=box, fontname=\"monospace\"];\n";
+    }
+
+    void node(uint64_t id, uint64_t parent, char side, int depth, const std::pair<const Key, Value>& item, bool hasBalance, int8_t balance)
+    {
+        out_ << "  n" << id << " [label=\"";
+        ExportText::label(out_, item.first);
+        if(values_){
+            out_ << ": ";
+            ExportText::label(out_, item.second);
+        }
+        out_ << "\\nd=" << depth;
+        if(hasBalance){
+            out_ << " b=" << (int)balance;
+        }
+        out_ << "\"];\n";
+        if(parent != EXPORT_BST_NO_PARENT){
+            out_ << "  n" << parent << " -> n" << id << ";\n";
+        }
+    }
+
+    void cut(uint64_t parent, char side, int depth)
+    {
+        //the root is always written, so a cut subtree has a parent
+        out_ << "  c" << parent << side << " [label=\"...\", shape=plaintext];\n"
+             << "  n" << parent << " -> c" << parent << side << " [style=dashed];\n";
+    }
+
+    void end(uint64_t exported, uint64_t cut)
+    {
+        out_ << "  // " << exported << " nodes exported, " << cut << " subtrees cut\n"
+             << "}\n";
+    }
+
+private:
+    std::ostream& out_;
+    bool values_;
+};
+
+/**
+* exportWalk() visitor that writes JSON.
+*/
+template<typename Key, typename Value>
+class JsonTreeWriter
+{
+public:
+    JsonTreeWriter(std::ostream& out, bool values) : out_(out), values_(values), first_(true) { }
+
+    void begin()
+    {
+        out_ << "{\"nodes\":[";
+    }
+
+    void node(uint64_t id, uint64_t parent, char side, int depth, const std::pair<const Key, Value>& item, bool hasBalance, int8_t balance)
+    {
+        separate();
+        out_ << "{\"id\":" << id << ",\"parent\":";
+        position(parent, side, depth);
+        out_ << ",\"key\":";
+        ExportText::json(out_, item.first);
+        if(values_){
+            out_ << ",\"value\":";
+            ExportText::json(out_, item.second);
+        }
+        if(hasBalance){
+            out_ << ",\"balance\":" << (int)balance;
+        }
+        out_ << '}';
+    }
+
+    void cut(uint64_t parent, char side, int depth)
+    {
+        separate();
+        out_ << "{\"cut\":true,\"parent\":";
+        position(parent, side, depth);
+        out_ << '}';
+    }
+
+    void end(uint64_t exported, uint64_t cut)
+    {
+        out_ << "\n],\"exported\":" << exported << ",\"cut\":" << cut << "}\n";
+    }
+
+private:
+    void separate()
+    {
+        out_ << (first_ ? "\n" : ",\n");
+        first_ = false;
+    }
+
+    // the rest of an element after "parent":
+    void position(uint64_t parent, char side, int depth)
+    {
+        if(parent == EXPORT_BST_NO_PARENT){
+            out_ << "null";
+        }
+        else{
+            out_ << parent;
+        }
+        out_ << ",\"side\":\"" << (side == 'L' ? "left" : side == 'R' ? "right" : "root")
+             << "\",\"depth\":" << depth;
+    }
+
+    std::ostream& out_;
+    bool values_;
+    bool first_;
+};
+
+/**
+* Walks the tree in pre-order, left child first, and hands each node (or,
+* where the options leave a subtree out, a cut stub) to the visitor:
+*   visitor.begin()
+*   visitor.node(id, parentId, side, depth, item, hasBalance, balance)
+*   visitor.cut(parentId, side, depth)
+*   visitor.end(nodesExported, subtreesCut)
+* side is 'L', 'R', or 0 for the root, whose parent id is
+* EXPORT_BST_NO_PARENT. Ids count the nodes written so far.
+*/
+template<typename Key, typename Value>
+template<typename Visitor>
+void BinarySearchTree<Key, Value>::exportWalk(Visitor& visitor, const ExportOptions& options) const
+{
+    struct Pending
+    {
+        Node<Key, Value>* node;
+        uint64_t parent;
+        int depth;
+        char side;
+    };
+
+    //right children wait here while their left siblings are written, so
+    //there is at most one entry per level (plus the one being expanded)
+    std::vector<Pending> pending;
+    uint64_t exported = 0;
+    uint64_t cut = 0;
+    uint64_t sampled = 0;
+
+    visitor.begin();
+    if(root_ != nullptr){
+        Pending root = {root_, EXPORT_BST_NO_PARENT, 1, 0};
+        pending.push_back(root);
+    }
+    while(!pending.empty()){
+        Pending current = pending.back();
+        pending.pop_back();
+
+        bool keep = true;
+        if(options.maxDepth > 0 && current.depth > options.maxDepth){
+            keep = false;
+        }
+        else if(options.maxNodes > 0 && exported >= options.maxNodes){
+            keep = false;
+        }
+        else if(current.depth == options.sampleDepth && options.sampleEvery > 1){
+            keep = sampled % options.sampleEvery == 0;
+            ++sampled;
+        }
+        if(!keep){
+            visitor.cut(current.parent, current.side, current.depth);
+            ++cut;
+            continue;
+        }
+
+        uint64_t id = exported++;
+        int8_t balance = 0;
+        bool hasBalance = storedBalance(current.node, balance);
+        visitor.node(id, current.parent, current.side, current.depth, current.node->getItem(), hasBalance, balance);
+
+        Node<Key, Value>* right = current.node->getRight();
+        if(right != nullptr){
+            Pending next = {right, id, current.depth + 1, 'R'};
+            pending.push_back(next);
+        }
+        Node<Key, Value>* left = current.node->getLeft();
+        if(left != nullptr){
+            Pending next = {left, id, current.depth + 1, 'L'};
+            pending.push_back(next);
+        }
+    }
+    visitor.end(exported, cut);
+}
+
+/**
+* Writes the tree as a Graphviz digraph (render with e.g. dot -Tsvg).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportDot(std::ostream& out, const ExportOptions& options) const
+{
+    DotTreeWriter<Key, Value> writer(out, options.values);
+    exportWalk(writer, options);
+}
+
+/**
+* Writes the tree as one JSON object with a flat array of nodes.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportJson(std::ostream& out, const ExportOptions& options) const
+{
+    JsonTreeWriter<Key, Value> writer(out, options.values);
+    exportWalk(writer, options);
+}
+
+#endif
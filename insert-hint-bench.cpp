@@ -0,0 +1,118 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Compares plain insert() against hinted insert() on AVLTree for key streams
+// that arrive (almost) in increasing order.
+//
+// usage: ./insert-hint-bench [numKeys] [toothWidth]
+
+// keys 0, 1, 2, ... n-1
+vector<int> monotoneKeys(int n)
+{
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++){
+        keys[i] = i;
+    }
+    return keys;
+}
+
+// ascending runs of width keys, each run placed below every earlier run,
+// so only the first key of a run misses the hint
+vector<int> sawtoothKeys(int n, int width)
+{
+    vector<int> keys(n);
+    int numTeeth = (n + width - 1) / width;
+    for(int i = 0; i < n; i++){
+        keys[i] = (numTeeth - 1 - i / width) * width + i % width;
+    }
+    return keys;
+}
+
+double plainInsert(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / keys.size();
+}
+
+// hint is always end(), which only helps when appending new maximums
+double endHintInsert(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); i++){
+        tree.insert(tree.end(), make_pair(keys[i], keys[i]));
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / keys.size();
+}
+
+// hint is the position of the previously inserted key
+double lastHintInsert(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    AVLTree<int, int>::iterator hint = tree.end();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); i++){
+        hint = tree.emplace_hint(hint, keys[i], keys[i]);
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / keys.size();
+}
+
+// best of a few runs, so page faults and the order in which freed nodes get
+// recycled by the allocator do not decide which mode looks fastest
+double bestOf(double (*run)(const vector<int>&), const vector<int>& keys)
+{
+    const int reps = 3;
+    double best = run(keys);
+    for(int i = 1; i < reps; i++){
+        best = min(best, run(keys));
+    }
+    return best;
+}
+
+void report(const string& stream, const vector<int>& keys)
+{
+    cout << left << setw(10) << stream
+         << right << fixed << setprecision(1)
+         << setw(14) << bestOf(plainInsert, keys)
+         << setw(14) << bestOf(endHintInsert, keys)
+         << setw(14) << bestOf(lastHintInsert, keys) << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int width = argc > 2 ? atoi(argv[2]) : 1000;
+    if(n <= 0 || width <= 0){
+        cerr << "usage: " << argv[0] << " [numKeys] [toothWidth]" << endl;
+        return 1;
+    }
+
+    //warm up the heap so the first mode measured does not pay for fresh pages
+    plainInsert(monotoneKeys(n));
+
+    cout << "AVLTree insert, " << n << " keys, ns per insert" << endl;
+    cout << left << setw(10) << "stream"
+         << right << setw(14) << "insert"
+         << setw(14) << "hint=end()"
+         << setw(14) << "hint=last" << endl;
+
+    report("monotone", monotoneKeys(n));
+    report("sawtooth", sawtoothKeys(n, width));
+    return 0;
+}
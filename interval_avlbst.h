@@ -0,0 +1,351 @@
+#ifndef INTERVAL_AVLBST_H
+#define INTERVAL_AVLBST_H
+
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+
+// Interval tree: an AVLTree keyed by half-open intervals [start, end),
+// ordered by start and then end, whose nodes also keep the largest end in
+// their subtree (maxEnd).
+//
+// maxEnd is maintained through the same AVLTree hooks as AugmentedAVLTree
+// (see augmented_avlbst.h): the path to the root is refreshed on insert and
+// remove before any rotation, rotations recompute their two nodes, nodeSwap()
+// keeps maxEnd with the position, and bulk builds compute it bottom-up.
+//
+// Queries, for an interval x:
+//   anyOverlap(x)        one stored interval overlapping x, or end(): a
+//                        single root-to-leaf descent, O(log n)
+//   overlapping(x, out)  every stored interval overlapping x, in start order.
+//                        Subtrees whose maxEnd <= x.start or whose starts are
+//                        all >= x.end are skipped, so it visits O(log n)
+//                        nodes plus the paths down to the k results: O(log n
+//                        + k) when the results sit close together in start
+//                        order, O(min(n, k log n)) at worst
+// insertBatch() adds many intervals with one sort and a linear rebuild
+// instead of one rebalancing insert each, unless the batch is small next to
+// the tree, where m inserts at O(log n) each beat rebuilding all n nodes.
+//
+// Stored intervals must be non-empty (start < end): an empty one would count
+// towards maxEnd without being able to overlap anything, and anyOverlap()
+// relies on every interval it is steered towards being a real candidate.
+// Each distinct interval is one entry; inserting the same [start, end)
+// again overwrites its value, as with any AVLTree key.
+
+/**
+* Half-open interval [start, end) of any ordered Point type.
+*/
+template<typename Point>
+struct Interval
+{
+    Point start;
+    Point end;
+
+    Interval() : start(), end() { }
+    Interval(const Point& s, const Point& e) : start(s), end(e) { }
+
+    // empty intervals (start == end) overlap nothing
+    bool overlaps(const Interval& other) const
+    {
+        return start < other.end && other.start < end;
+    }
+};
+
+template<typename Point>
+bool operator<(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return a.start < b.start || (!(b.start < a.start) && a.end < b.end);
+}
+
+template<typename Point>
+bool operator>(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return b < a;
+}
+
+template<typename Point>
+bool operator==(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+template<typename Point>
+std::ostream& operator<<(std::ostream& out, const Interval<Point>& interval)
+{
+    return out << '[' << interval.start << ", " << interval.end << ')';
+}
+
+/**
+* AVLNode plus the largest end in its subtree.
+*/
+template<typename Point, typename Value>
+class IntervalNode : public AVLNode<Interval<Point>, Value>
+{
+public:
+    IntervalNode(const Interval<Point>& key, const Value& value, AVLNode<Interval<Point>, Value>* parent) :
+        AVLNode<Interval<Point>, Value>(key, value, parent),
+        maxEnd_(key.end)
+    {
+
+    }
+
+    Point maxEnd_;
+};
+
+template<typename Point, typename Value>
+class IntervalTree : public AVLTree<Interval<Point>, Value>
+{
+public:
+    typedef Interval<Point> Key;
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    template<typename InputIt>
+    void insertBatch(InputIt first, InputIt last);
+
+    iterator anyOverlap(const Key& x) const;
+    template<typename OutputIt>
+    OutputIt overlapping(const Key& x, OutputIt out) const;
+
+protected:
+    typedef IntervalNode<Point, Value> Augmented;
+
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void setBuiltBalance(Node<Key, Value>* n, int8_t balance);
+    virtual size_t nodeSize() const;
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void augmentNode(AVLNode<Key, Value>* n);
+    virtual void augmentPath(AVLNode<Key, Value>* n);
+
+    static const Point& maxEnd(Node<Key, Value>* n);
+    static void checkInterval(const Key& key);
+
+    /**
+    * Feeds sorted entries from a vector to the bulk build.
+    */
+    class EntrySource
+    {
+    public:
+        EntrySource(const std::vector<std::pair<Key, Value> >& entries) : entries_(entries), next_(0) { }
+
+        Key readKey()
+        {
+            return entries_[next_].first;
+        }
+
+        Value readValue()
+        {
+            return entries_[next_++].second;
+        }
+
+    private:
+        const std::vector<std::pair<Key, Value> >& entries_;
+        size_t next_;
+    };
+};
+
+/**
+* Throws std::invalid_argument for an empty or backwards interval.
+*/
+template<typename Point, typename Value>
+void IntervalTree<Point, Value>::checkInterval(const Key& key)
+{
+    if(!(key.start < key.end)){
+        throw std::invalid_argument("interval must start before it ends");
+    }
+}
+
+/**
+* Adds the (interval, value) pairs in [first, last), keeping the last value
+* given for an interval that appears more than once (or is already stored).
+* The whole batch is checked first, so a bad interval leaves the tree as it
+* was.
+*
+* When m log n < n for m new entries, they are inserted one at a time in
+* O(m log n); if one throws, those before it stay inserted. Otherwise the
+* batch is sorted, merged with the stored entries and built into a new tree in
+* one linear bulk build, O(n + m log m), which replaces the old one only once
+* it is complete: if building throws (say bad_alloc), the tree is left as it
+* was. The rebuild briefly holds both trees.
+*/
+template<typename Point, typename Value>
+template<typename InputIt>
+void IntervalTree<Point, Value>::insertBatch(InputIt first, InputIt last)
+{
+    typedef std::pair<Key, Value> Entry;
+    std::vector<Entry> batch(first, last);
+    for(size_t i = 0; i < batch.size(); i++){
+        checkInterval(batch[i].first);
+    }
+
+    size_t logSize = 0;
+    for(size_t n = this->size(); n > 1; n /= 2){
+        ++logSize;
+    }
+    if(batch.size() * logSize < this->size()){
+        //in the given order, so a later duplicate overwrites an earlier one
+        for(size_t i = 0; i < batch.size(); i++){
+            this->insert(batch[i]);
+        }
+        return;
+    }
+
+    //stable, so of equal intervals the one given last ends up last
+    std::stable_sort(batch.begin(), batch.end(),
+        [](const Entry& a, const Entry& b) { return a.first < b.first; });
+
+    std::vector<Entry> merged;
+    merged.reserve(this->size() + batch.size());
+    iterator stored = this->begin();
+    for(size_t i = 0; i < batch.size(); i++){
+        if(i + 1 < batch.size() && batch[i].first == batch[i + 1].first){
+            continue;
+        }
+        while(stored != this->end() && stored->first < batch[i].first){
+            merged.push_back(Entry(stored->first, stored->second));
+            ++stored;
+        }
+        if(stored != this->end() && stored->first == batch[i].first){
+            ++stored;
+        }
+        merged.push_back(batch[i]);
+    }
+    for(; stored != this->end(); ++stored){
+        merged.push_back(Entry(stored->first, stored->second));
+    }
+
+    //built off to the side (buildSubtree frees its partial work if it
+    //throws); the old nodes go only once the new ones are all in place
+    EntrySource source(merged);
+    Node<Key, Value>* rightmost = nullptr;
+    int height = 0;
+    Node<Key, Value>* root = this->buildSubtree(source, merged.size(), rightmost, height);
+    this->clear();
+    this->root_ = root;
+    this->rightmost_ = rightmost;
+    this->size_ = merged.size();
+}
+
+/**
+* Some stored interval that overlaps x, or end(). Goes left whenever the left
+* subtree reaches past x.start: if nothing there overlaps x, one of its
+* intervals starts at or after x.end, and so does everything to the right.
+*/
+template<typename Point, typename Value>
+typename IntervalTree<Point, Value>::iterator IntervalTree<Point, Value>::anyOverlap(const Key& x) const
+{
+    Node<Key, Value>* n = this->root_;
+    while(n){
+        if(n->getKey().overlaps(x)){
+            return this->iteratorAt(n);
+        }
+        if(n->getLeft() && x.start < maxEnd(n->getLeft())){
+            n = n->getLeft();
+        }
+        else{
+            n = n->getRight();
+        }
+    }
+    return this->end();
+}
+
+/**
+* Writes an iterator to every stored interval overlapping x to out, in start
+* order, and returns the advanced out. Walks in order with an explicit stack
+* of at most the tree height, pruning subtrees that end too early or start
+* too late.
+*/
+template<typename Point, typename Value>
+template<typename OutputIt>
+OutputIt IntervalTree<Point, Value>::overlapping(const Key& x, OutputIt out) const
+{
+    //a node is pushed once its left subtree has been dealt with
+    std::vector<Node<Key, Value>*> pending;
+    Node<Key, Value>* n = this->root_;
+    while(n || !pending.empty()){
+        //go down left while that subtree reaches past x.start
+        while(n && x.start < maxEnd(n)){
+            pending.push_back(n);
+            n = n->getLeft();
+        }
+        if(pending.empty()){
+            break;
+        }
+        n = pending.back();
+        pending.pop_back();
+
+        //this start and every one after it is too late
+        if(!(n->getKey().start < x.end)){
+            break;
+        }
+        if(n->getKey().overlaps(x)){
+            *out++ = this->iteratorAt(n);
+        }
+        n = n->getRight();
+    }
+    return out;
+}
+
+/**
+* Every insert, hinted insert and bulk load makes its nodes here, so this is
+* where an empty or backwards interval is turned away.
+*/
+template<typename Point, typename Value>
+Node<Interval<Point>, Value>* IntervalTree<Point, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    checkInterval(key);
+    return new Augmented(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+template<typename Point, typename Value>
+void IntervalTree<Point, Value>::setBuiltBalance(Node<Key, Value>* n, int8_t balance)
+{
+    AVLTree<Key, Value>::setBuiltBalance(n, balance);
+    augmentNode(static_cast<AVLNode<Key, Value>*>(n));
+}
+
+template<typename Point, typename Value>
+size_t IntervalTree<Point, Value>::nodeSize() const
+{
+    return sizeof(Augmented);
+}
+
+template<typename Point, typename Value>
+void IntervalTree<Point, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value>::nodeSwap(n1, n2);
+    std::swap(static_cast<Augmented*>(n1)->maxEnd_, static_cast<Augmented*>(n2)->maxEnd_);
+}
+
+template<typename Point, typename Value>
+void IntervalTree<Point, Value>::augmentNode(AVLNode<Key, Value>* n)
+{
+    Point largest = n->getKey().end;
+    if(n->getLeft() && largest < maxEnd(n->getLeft())){
+        largest = maxEnd(n->getLeft());
+    }
+    if(n->getRight() && largest < maxEnd(n->getRight())){
+        largest = maxEnd(n->getRight());
+    }
+    static_cast<Augmented*>(n)->maxEnd_ = largest;
+}
+
+template<typename Point, typename Value>
+void IntervalTree<Point, Value>::augmentPath(AVLNode<Key, Value>* n)
+{
+    while(n){
+        augmentNode(n);
+        n = n->getParent();
+    }
+}
+
+template<typename Point, typename Value>
+const Point& IntervalTree<Point, Value>::maxEnd(Node<Key, Value>* n)
+{
+    return static_cast<Augmented*>(n)->maxEnd_;
+}
+
+#endif
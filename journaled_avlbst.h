@@ -0,0 +1,540 @@
+#ifndef JOURNALED_AVLBST_H
+#define JOURNALED_AVLBST_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+// Durable AVLTree: every insert/remove is appended to a write-ahead log.
+//
+// Files, for a base path P:
+//   P.snap      last snapshot (BinarySearchTree::save format)
+//   P.wal       active log, appended to by insert()/remove()
+//   P.wal.old   sealed log that a background compaction is folding into P.snap
+//
+// Group commit: records are buffered and written + fsync'ed once per
+// groupCommitSize operations (or on commit()), so one fsync covers the whole
+// group. An operation is durable only once its group has been committed.
+// If writing or syncing a group fails, the log is truncated back to the end
+// of the last committed frame and the group stays pending for the next
+// commit(): a partial frame left in the log would stop replay there and hide
+// every group appended after it. If even the truncation fails, the journal
+// refuses all further operations.
+//
+// Each group is one frame: uint32_t payload length, uint32_t record count,
+// uint32_t FNV-1a checksum of the payload, then the payload. The payload is
+// in the snapshot block format, and each record is a uint8_t op followed by
+// the key (and, for inserts, the value), encoded by SnapshotSerializer.
+// A frame that is cut short or fails its checksum marks a torn write from a
+// crash: replay stops there and the log is truncated back to the last good
+// frame.
+//
+// Compaction: once the active log passes compactBytes, it is renamed to
+// P.wal.old and a new P.wal is started. A background thread then loads
+// P.snap, replays P.wal.old into a private tree, writes the new snapshot to
+// P.snap.tmp, fsyncs it, renames it over P.snap and deletes P.wal.old. The
+// live tree is never touched by that thread. If a crash leaves P.wal.old
+// behind, recovery replays it before P.wal. Replaying a log whose effects are
+// already in the snapshot is harmless, because the last operation on each key
+// wins either way. The directory is fsynced after every file is created or
+// renamed, so a committed group survives a crash at any point of this.
+//
+// P.wal.old is only ever deleted once it has been folded in. If a compaction
+// fails, the sealed log stays and the log is not rotated again until a
+// synchronous retry has folded it (the next rollover, compact() or
+// waitForCompaction() tries). Until then the error is kept and reported by
+// compact() and waitForCompaction(); insert() and remove() never throw it,
+// since their operation has already been applied and committed. A failed
+// rollover is retried once the log has grown by another compactBytes.
+//
+// Not thread safe: one thread should own the wrapper.
+
+#define JOURNAL_OP_INSERT 1
+#define JOURNAL_OP_REMOVE 2
+
+template <typename Key, typename Value>
+class JournaledAVLTree
+{
+public:
+    JournaledAVLTree(const std::string& basePath, size_t groupCommitSize = 64, uint64_t compactBytes = (uint64_t)64 << 20);
+    ~JournaledAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void commit();
+    void compact();
+    void waitForCompaction();
+
+    const AVLTree<Key, Value>& tree() const;
+
+private:
+    JournaledAVLTree(const JournaledAVLTree&);
+    JournaledAVLTree& operator=(const JournaledAVLTree&);
+
+    void checkUsable() const;
+    void recordDone();
+    void startCompaction();
+    void foldSealed();
+    void openLog();
+
+    static bool fileExists(const std::string& path);
+    static void writeAll(int fd, const char* data, size_t length);
+    static void syncFile(const std::string& path);
+    static void syncDirectory(const std::string& path);
+    static uint32_t checksum(const char* data, size_t length);
+    static uint64_t replay(const std::string& path, AVLTree<Key, Value>& tree);
+    static void compactFiles(std::string snapPath, std::string sealedPath, std::exception_ptr* error, std::atomic<bool>* running);
+
+    AVLTree<Key, Value> tree_;
+    std::string snapPath_;
+    std::string logPath_;
+    std::string sealedPath_;
+    int logFd_;
+    uint64_t logBytes_;
+    size_t groupCommitSize_;
+    uint64_t compactBytes_;
+    // log size at which the next rollover is tried
+    uint64_t compactAt_;
+
+    // records of the group that has not been committed yet
+    std::ostringstream pending_;
+    SnapshotWriter pendingWriter_;
+    uint32_t pendingOps_;
+    // set when a failed write could not be cut back off the log
+    bool failed_;
+
+    std::thread compactor_;
+    std::atomic<bool> compacting_;
+    std::exception_ptr compactError_;
+};
+
+/**
+* Recovers the tree from basePath's snapshot and logs, then opens the log for
+* appending. Finishes any compaction that a crash interrupted in the background.
+*/
+template<typename Key, typename Value>
+JournaledAVLTree<Key, Value>::JournaledAVLTree(const std::string& basePath, size_t groupCommitSize, uint64_t compactBytes) :
+    snapPath_(basePath + ".snap"),
+    logPath_(basePath + ".wal"),
+    sealedPath_(basePath + ".wal.old"),
+    logFd_(-1),
+    logBytes_(0),
+    groupCommitSize_(groupCommitSize > 0 ? groupCommitSize : 1),
+    compactBytes_(compactBytes),
+    compactAt_(compactBytes),
+    pendingWriter_(pending_),
+    pendingOps_(0),
+    failed_(false),
+    compacting_(false)
+{
+    if(fileExists(snapPath_)){
+        std::ifstream in(snapPath_.c_str(), std::ios::binary);
+        tree_.load(in);
+    }
+    bool sealed = fileExists(sealedPath_);
+    if(sealed){
+        replay(sealedPath_, tree_);
+    }
+    if(fileExists(logPath_)){
+        uint64_t valid = replay(logPath_, tree_);
+        if(truncate(logPath_.c_str(), valid) != 0){
+            throw std::runtime_error("cannot truncate torn log " + logPath_);
+        }
+    }
+    openLog();
+    syncDirectory(logPath_);
+
+    if(sealed){
+        compacting_ = true;
+        compactor_ = std::thread(compactFiles, snapPath_, sealedPath_, &compactError_, &compacting_);
+    }
+}
+
+/**
+* Commits any buffered operations and waits for a running compaction.
+*/
+template<typename Key, typename Value>
+JournaledAVLTree<Key, Value>::~JournaledAVLTree()
+{
+    try{
+        commit();
+    }
+    catch(...){
+        // destructors must not throw; the uncommitted group is lost like a crash
+    }
+    if(compactor_.joinable()){
+        compactor_.join();
+    }
+    if(logFd_ >= 0){
+        ::close(logFd_);
+    }
+}
+
+/**
+* Inserts into the tree and logs the operation.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    checkUsable();
+    tree_.insert(keyValuePair);
+
+    uint8_t op = JOURNAL_OP_INSERT;
+    pendingWriter_.write(&op, sizeof(op));
+    SnapshotSerializer<Key>::write(pendingWriter_, keyValuePair.first);
+    SnapshotSerializer<Value>::write(pendingWriter_, keyValuePair.second);
+    recordDone();
+}
+
+/**
+* Removes from the tree and logs the operation.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::remove(const Key& key)
+{
+    checkUsable();
+    tree_.remove(key);
+
+    uint8_t op = JOURNAL_OP_REMOVE;
+    pendingWriter_.write(&op, sizeof(op));
+    SnapshotSerializer<Key>::write(pendingWriter_, key);
+    recordDone();
+}
+
+template<typename Key, typename Value>
+const AVLTree<Key, Value>& JournaledAVLTree<Key, Value>::tree() const
+{
+    return tree_;
+}
+
+/**
+* Throws std::runtime_error once a failed write has left the log in a state
+* that later frames must not be appended to.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::checkUsable() const
+{
+    if(failed_){
+        throw std::runtime_error("log " + logPath_ + " could not be repaired after a failed write");
+    }
+}
+
+/**
+* Commits the group once it is full, and rotates the log once it is large.
+* A rollover that fails leaves its error for waitForCompaction() instead of
+* throwing: the operation is already applied and committed.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::recordDone()
+{
+    ++pendingOps_;
+    if(pendingOps_ >= groupCommitSize_){
+        commit();
+        //only one compaction at a time; a finished one is joined first
+        if(logBytes_ >= compactAt_ && !compacting_){
+            try{
+                waitForCompaction();
+                startCompaction();
+            }
+            catch(...){
+                compactError_ = std::current_exception();
+                compactAt_ = logBytes_ + compactBytes_;
+            }
+        }
+    }
+}
+
+/**
+* Writes the buffered group as one frame and fsyncs it. Everything logged
+* before this call is durable once it returns. If it throws, the group is
+* still pending and the log ends at the last committed frame, so commit() can
+* be retried.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::commit()
+{
+    checkUsable();
+    if(pendingOps_ == 0){
+        return;
+    }
+
+    pendingWriter_.finish();
+    std::string payload = pending_.str();
+
+    uint32_t frame[3];
+    frame[0] = (uint32_t)payload.size();
+    frame[1] = pendingOps_;
+    frame[2] = checksum(payload.data(), payload.size());
+
+    try{
+        writeAll(logFd_, reinterpret_cast<const char*>(frame), sizeof(frame));
+        writeAll(logFd_, payload.data(), payload.size());
+        if(fsync(logFd_) != 0){
+            throw std::runtime_error("fsync failed on " + logPath_);
+        }
+    }
+    catch(...){
+        //cut off whatever part of the frame made it in
+        if(ftruncate(logFd_, logBytes_) != 0){
+            failed_ = true;
+        }
+        //keep the group, minus the end marker, so later records follow it
+        pending_.str(payload.substr(0, payload.size() - sizeof(uint32_t)));
+        pending_.seekp(0, std::ios::end);
+        throw;
+    }
+
+    pending_.str("");
+    pendingOps_ = 0;
+    logBytes_ += sizeof(frame) + payload.size();
+}
+
+/**
+* Seals the current log and folds it into the snapshot in the background.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::compact()
+{
+    commit();
+    waitForCompaction();
+    if(logBytes_ > 0){
+        startCompaction();
+    }
+}
+
+/**
+* Blocks until a running compaction finishes. If it (or an earlier one)
+* failed, retries folding the sealed log in here; the error is cleared only
+* once that worked, and is rethrown otherwise.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::waitForCompaction()
+{
+    if(compactor_.joinable()){
+        compactor_.join();
+    }
+    if(compactError_){
+        try{
+            foldSealed();
+        }
+        catch(...){
+            compactError_ = std::current_exception();
+            throw;
+        }
+        compactError_ = nullptr;
+    }
+}
+
+/**
+* Rotates the active log to the sealed name and starts the compaction thread.
+* The caller makes sure no compaction is running or left unjoined. A sealed
+* log still left over from a failed compaction is folded in first, since
+* sealing would replace it; if that fails, the log is not rotated.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::startCompaction()
+{
+    foldSealed();
+
+    ::close(logFd_);
+    logFd_ = -1;
+    if(rename(logPath_.c_str(), sealedPath_.c_str()) != 0){
+        openLog();
+        throw std::runtime_error("cannot seal log " + logPath_);
+    }
+    openLog();
+    syncDirectory(logPath_);
+    compactAt_ = compactBytes_;
+    compacting_ = true;
+    compactor_ = std::thread(compactFiles, snapPath_, sealedPath_, &compactError_, &compacting_);
+}
+
+/**
+* Folds a sealed log that is still on disk into the snapshot, on this thread.
+* No compaction may be running.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::foldSealed()
+{
+    if(!fileExists(sealedPath_)){
+        return;
+    }
+    std::exception_ptr error;
+    std::atomic<bool> running(true);
+    compactFiles(snapPath_, sealedPath_, &error, &running);
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::openLog()
+{
+    logFd_ = ::open(logPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(logFd_ < 0){
+        throw std::runtime_error("cannot open log " + logPath_);
+    }
+    struct stat info;
+    logBytes_ = fstat(logFd_, &info) == 0 ? info.st_size : 0;
+}
+
+/**
+* Background half of compaction: snapshot + sealed log -> new snapshot.
+* Errors are handed back through error for waitForCompaction() to rethrow.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::compactFiles(std::string snapPath, std::string sealedPath, std::exception_ptr* error, std::atomic<bool>* running)
+{
+    try{
+        AVLTree<Key, Value> tree;
+        if(fileExists(snapPath)){
+            std::ifstream in(snapPath.c_str(), std::ios::binary);
+            tree.load(in);
+        }
+        replay(sealedPath, tree);
+
+        std::string tmpPath = snapPath + ".tmp";
+        {
+            std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+            tree.save(out);
+            out.flush();
+            if(!out){
+                throw std::runtime_error("cannot write snapshot " + tmpPath);
+            }
+        }
+        syncFile(tmpPath);
+        if(rename(tmpPath.c_str(), snapPath.c_str()) != 0){
+            throw std::runtime_error("cannot replace snapshot " + snapPath);
+        }
+        //the new snapshot must be in place for good before its log goes
+        syncDirectory(snapPath);
+        std::remove(sealedPath.c_str());
+    }
+    catch(...){
+        *error = std::current_exception();
+    }
+    *running = false;
+}
+
+/**
+* Applies every intact frame of the log at path to tree. Returns the length of
+* the valid prefix of the file, which ends before the first torn frame.
+*/
+template<typename Key, typename Value>
+uint64_t JournaledAVLTree<Key, Value>::replay(const std::string& path, AVLTree<Key, Value>& tree)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::vector<char> log((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    uint64_t offset = 0;
+    while(offset + 3 * sizeof(uint32_t) <= log.size()){
+        uint32_t frame[3];
+        std::memcpy(frame, &log[offset], sizeof(frame));
+        uint64_t start = offset + sizeof(frame);
+        if(start + frame[0] > log.size() || checksum(&log[start], frame[0]) != frame[2]){
+            break;
+        }
+
+        std::istringstream payload(std::string(&log[start], frame[0]));
+        SnapshotReader reader(payload);
+        for(uint32_t i = 0; i < frame[1]; i++){
+            uint8_t op = 0;
+            reader.read(&op, sizeof(op));
+            Key key = SnapshotSerializer<Key>::read(reader);
+            if(op == JOURNAL_OP_INSERT){
+                Value value = SnapshotSerializer<Value>::read(reader);
+                tree.insert(std::make_pair(key, value));
+            }
+            else if(op == JOURNAL_OP_REMOVE){
+                tree.remove(key);
+            }
+            else{
+                throw std::runtime_error("unknown record in log " + path);
+            }
+        }
+        reader.finish();
+        offset = start + frame[0];
+    }
+    return offset;
+}
+
+template<typename Key, typename Value>
+bool JournaledAVLTree<Key, Value>::fileExists(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::writeAll(int fd, const char* data, size_t length)
+{
+    while(length > 0){
+        ssize_t written = ::write(fd, data, length);
+        if(written < 0){
+            throw std::runtime_error("log write failed");
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::syncFile(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0 || fsync(fd) != 0){
+        if(fd >= 0){
+            ::close(fd);
+        }
+        throw std::runtime_error("fsync failed on " + path);
+    }
+    ::close(fd);
+}
+
+/**
+* fsyncs the directory holding path, which makes a file created or renamed
+* there durable.
+*/
+template<typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::syncDirectory(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0 || fsync(fd) != 0){
+        if(fd >= 0){
+            ::close(fd);
+        }
+        throw std::runtime_error("fsync failed on directory " + directory);
+    }
+    ::close(fd);
+}
+
+/**
+* 32-bit FNV-1a, enough to spot a torn or garbled frame.
+*/
+template<typename Key, typename Value>
+uint32_t JournaledAVLTree<Key, Value>::checksum(const char* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++){
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-operation latency recording for the benchmarks.
+//
+// CycleClock reads the time stamp counter where there is one (a few ns per
+// read, no syscall) and falls back to std::chrono::steady_clock elsewhere.
+// LatencyHistogram stores samples in log-linear buckets: values below
+// LATENCY_SUB_BUCKETS are exact, above that every power of two is split into
+// LATENCY_SUB_BUCKETS linear steps, so a reported percentile is at most
+// 1/LATENCY_SUB_BUCKETS (6.25%) above the true value. It is a fixed array,
+// so recording never allocates.
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/**
+* Cheap timestamps in ticks, plus the tick rate measured against steady_clock.
+* Assumes an invariant TSC, which every x86-64 CPU of the last decade has.
+*/
+struct CycleClock
+{
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // ticks per nanosecond, measured once over about 20 ms
+    static double ticksPerNs()
+    {
+        static double rate = 0;
+        if(rate == 0){
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            uint64_t startTicks = now();
+            std::chrono::steady_clock::duration elapsed;
+            do{
+                elapsed = std::chrono::steady_clock::now() - start;
+            } while(elapsed < std::chrono::milliseconds(20));
+            uint64_t ticks = now() - startTicks;
+            rate = (double)ticks / std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+        return rate;
+    }
+};
+
+/**
+* Log-bucketed histogram of non-negative samples (in CycleClock ticks).
+*/
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        max_ = 0;
+    }
+
+    void record(uint64_t value)
+    {
+        ++counts_[bucketOf(value)];
+        ++count_;
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for(int i = 0; i < LATENCY_BUCKETS; i++){
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    /**
+    * Returns the smallest bucket upper bound that at least fraction of the
+    * samples fall under (fraction 0.99 gives p99), capped at max().
+    */
+    uint64_t percentile(double fraction) const
+    {
+        if(count_ == 0){
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(fraction * count_);
+        if(rank >= count_){
+            rank = count_ - 1;
+        }
+        uint64_t seen = 0;
+        for(int i = 0; i < LATENCY_BUCKETS; i++){
+            seen += counts_[i];
+            if(seen > rank){
+                return std::min(upperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static int bucketOf(uint64_t value)
+    {
+        if(value < LATENCY_SUB_BUCKETS){
+            return (int)value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - LATENCY_SUB_BITS;
+        return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((value >> shift) - LATENCY_SUB_BUCKETS);
+    }
+
+    static uint64_t upperBound(int bucket)
+    {
+        if(bucket < LATENCY_SUB_BUCKETS){
+            return bucket;
+        }
+        int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+        uint64_t lower = (uint64_t)(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+        return lower + (((uint64_t)1 << shift) - 1);
+    }
+
+    uint64_t counts_[LATENCY_BUCKETS];
+    uint64_t count_;
+    uint64_t max_;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef LEAF_DEPTH_PROFILE_H
+#define LEAF_DEPTH_PROFILE_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Shape of a binary tree in one O(n) pass: leaf count, shallowest and
+// deepest leaf, and how many leaves sit at each depth.
+//
+// leafDepthProfile() takes a pointer to any node type with either public
+// left/right members (the Node of equal-paths.h) or getLeft()/getRight()
+// (Node<Key, Value> and AVLNode<Key, Value> of bst.h). Depths count nodes,
+// so the root is at depth 1, as in equalPaths(); maxDepth is the height.
+// The walk uses an explicit stack, so degenerate trees do not overflow the
+// call stack.
+
+/**
+* Result of leafDepthProfile(). For an empty tree everything is 0.
+*/
+struct LeafDepthProfile
+{
+    uint64_t nodes;
+    uint64_t leaves;
+    int minDepth;
+    int maxDepth;
+    std::vector<uint64_t> histogram;    // histogram[d]: leaves at depth d
+
+    LeafDepthProfile() : nodes(0), leaves(0), minDepth(0), maxDepth(0) { }
+
+    // the answer of equalPaths(): every leaf at the same depth
+    bool equalPaths() const
+    {
+        return minDepth == maxDepth;
+    }
+};
+
+namespace detail {
+
+// child accessors for leafDepthProfile(), picked by which members the node
+// type has; kept out of the global namespace, where any type with left or
+// getLeft() would pick them up
+template<typename NodeT>
+auto leftChild(NodeT* n) -> decltype(n->left)
+{
+    return n->left;
+}
+
+template<typename NodeT>
+auto rightChild(NodeT* n) -> decltype(n->right)
+{
+    return n->right;
+}
+
+template<typename NodeT>
+auto leftChild(NodeT* n) -> decltype(n->getLeft())
+{
+    return n->getLeft();
+}
+
+template<typename NodeT>
+auto rightChild(NodeT* n) -> decltype(n->getRight())
+{
+    return n->getRight();
+}
+
+}
+
+/**
+* Profiles the tree under root in a single depth-first pass.
+*/
+template<typename NodeT>
+LeafDepthProfile leafDepthProfile(NodeT* root)
+{
+    LeafDepthProfile profile;
+    if(root == nullptr){
+        return profile;
+    }
+
+    std::vector<std::pair<NodeT*, int> > pending;
+    pending.push_back(std::make_pair(root, 1));
+    while(!pending.empty()){
+        NodeT* current = pending.back().first;
+        int depth = pending.back().second;
+        pending.pop_back();
+
+        //go down left children to a leaf, leaving right ones for later
+        while(true){
+            ++profile.nodes;
+            NodeT* left = detail::leftChild(current);
+            NodeT* right = detail::rightChild(current);
+            if(left == nullptr && right == nullptr){
+                break;
+            }
+            if(left != nullptr){
+                if(right != nullptr){
+                    pending.push_back(std::make_pair(right, depth + 1));
+                }
+                current = left;
+            }
+            else{
+                current = right;
+            }
+            ++depth;
+        }
+
+        if(profile.leaves == 0 || depth < profile.minDepth){
+            profile.minDepth = depth;
+        }
+        if(depth > profile.maxDepth){
+            profile.maxDepth = depth;
+        }
+        if((size_t)depth >= profile.histogram.size()){
+            profile.histogram.resize(depth + 1);
+        }
+        ++profile.histogram[depth];
+        ++profile.leaves;
+    }
+    return profile;
+}
+
+#endif
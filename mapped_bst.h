@@ -0,0 +1,365 @@
+#ifndef MAPPED_BST_H
+#define MAPPED_BST_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bst.h"
+
+// Read-only, memory-mapped tree images.
+//
+// MappedTree<Key, Value>::write() turns a BinarySearchTree into a file once,
+// offline. MappedTree::open() then mmaps that file. Opening does no parsing
+// and no heap allocation, so it takes the same time whatever the data size.
+// find(), lower_bound(), iteration and operator[] run directly on the mapped
+// pages, and the OS pages data in on first touch.
+//
+// File layout (version 1, native byte order, sections 64-byte aligned):
+//   header    MappedTreeHeader
+//   entries   count x Entry {key, value}, in increasing key order
+//   index     count x IndexNode {key, entry}, in BFS (Eytzinger) order: the
+//             children of slot i are slots 2i+1 and 2i+2, so a search walks
+//             a single array from front to back and the top levels share a
+//             few cache lines. entry is the offset (rank) of that key's
+//             record in the entries section; there are no pointers.
+//
+// Key and Value must be trivially copyable, since they are stored as raw bytes.
+
+#define MAPPED_BST_VERSION 1
+#define MAPPED_BST_ALIGN 64
+
+struct MappedTreeHeader
+{
+    char magic[4];          // "BSTI"
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint64_t count;
+    uint64_t entriesOffset;
+    uint64_t indexOffset;
+    uint64_t fileSize;
+};
+
+template <typename Key, typename Value>
+class MappedTree
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+        "MappedTree stores keys and values as raw bytes, so they must be trivially copyable");
+
+public:
+    /**
+    * A stored record. Mirrors the first/second members of the items in BinarySearchTree.
+    */
+    struct Entry
+    {
+        Key first;
+        Value second;
+    };
+
+    // iteration is a walk over the sorted entries section
+    typedef const Entry* iterator;
+
+    MappedTree();
+    ~MappedTree();
+
+    static void write(const BinarySearchTree<Key, Value>& tree, const std::string& path);
+
+    void open(const std::string& path);
+    void close();
+    bool empty() const;
+    uint64_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+
+private:
+    struct IndexNode
+    {
+        Key key;
+        uint64_t entry;
+    };
+
+    MappedTree(const MappedTree&);
+    MappedTree& operator=(const MappedTree&);
+
+    static uint64_t alignUp(uint64_t offset);
+    uint64_t indexEntry(const IndexNode& node) const;
+    static uint64_t fillIndex(const std::vector<Key>& sorted, std::vector<IndexNode>& index, uint64_t slot, uint64_t rank);
+
+    void* base_;
+    size_t length_;
+    const Entry* entries_;
+    const IndexNode* index_;
+    uint64_t count_;
+};
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::MappedTree() :
+    base_(nullptr),
+    length_(0),
+    entries_(nullptr),
+    index_(nullptr),
+    count_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+MappedTree<Key, Value>::~MappedTree()
+{
+    close();
+}
+
+template<typename Key, typename Value>
+uint64_t MappedTree<Key, Value>::alignUp(uint64_t offset)
+{
+    return (offset + MAPPED_BST_ALIGN - 1) / MAPPED_BST_ALIGN * MAPPED_BST_ALIGN;
+}
+
+/**
+* Lays the sorted keys out in BFS order by walking the implicit tree in order.
+* Returns the next unused rank.
+*/
+template<typename Key, typename Value>
+uint64_t MappedTree<Key, Value>::fillIndex(const std::vector<Key>& sorted, std::vector<IndexNode>& index, uint64_t slot, uint64_t rank)
+{
+    if(slot >= index.size()){
+        return rank;
+    }
+    rank = fillIndex(sorted, index, 2 * slot + 1, rank);
+    index[slot].key = sorted[rank];
+    index[slot].entry = rank;
+    return fillIndex(sorted, index, 2 * slot + 2, rank + 1);
+}
+
+/**
+* Writes an image of tree to path. This is the offline step: it holds a copy
+* of the keys in memory while it builds the index.
+*/
+template<typename Key, typename Value>
+void MappedTree<Key, Value>::write(const BinarySearchTree<Key, Value>& tree, const std::string& path)
+{
+    std::vector<Key> sorted;
+    for(typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it){
+        sorted.push_back(it->first);
+    }
+
+    MappedTreeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "BSTI", 4);
+    header.version = MAPPED_BST_VERSION;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.count = sorted.size();
+    header.entriesOffset = alignUp(sizeof(MappedTreeHeader));
+    header.indexOffset = alignUp(header.entriesOffset + header.count * sizeof(Entry));
+    header.fileSize = header.indexOffset + header.count * sizeof(IndexNode);
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out){
+        throw std::runtime_error("cannot create tree image " + path);
+    }
+
+    const char padding[MAPPED_BST_ALIGN] = {0};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding, header.entriesOffset - sizeof(header));
+
+    for(typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it){
+        Entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.first = it->first;
+        entry.second = it->second;
+        out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+    out.write(padding, header.indexOffset - (header.entriesOffset + header.count * sizeof(Entry)));
+
+    std::vector<IndexNode> index(sorted.size());
+    if(!index.empty()){
+        std::memset(&index[0], 0, index.size() * sizeof(IndexNode));
+        fillIndex(sorted, index, 0, 0);
+        out.write(reinterpret_cast<const char*>(&index[0]), index.size() * sizeof(IndexNode));
+    }
+
+    if(!out){
+        throw std::runtime_error("failed writing tree image " + path);
+    }
+}
+
+/**
+* Maps the image at path. Only the header is read and checked; everything else
+* is paged in on demand. Throws std::runtime_error if the file cannot be
+* mapped, was written for different Key/Value types, or has a header whose
+* sections do not fit in the file. Index entries are checked as searches
+* reach them (see indexEntry()), so opening stays O(1).
+*/
+template<typename Key, typename Value>
+void MappedTree<Key, Value>::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("cannot open tree image " + path);
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(MappedTreeHeader)){
+        ::close(fd);
+        throw std::runtime_error("not a tree image: " + path);
+    }
+
+    void* base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(base == MAP_FAILED){
+        throw std::runtime_error("cannot map tree image " + path);
+    }
+
+    //every field may be corrupt, so the sections are checked by dividing the
+    //space they have rather than multiplying count, which could wrap
+    const MappedTreeHeader* header = static_cast<const MappedTreeHeader*>(base);
+    bool valid = std::memcmp(header->magic, "BSTI", 4) == 0
+        && header->version == MAPPED_BST_VERSION
+        && header->keySize == sizeof(Key)
+        && header->valueSize == sizeof(Value)
+        && header->fileSize == (uint64_t)info.st_size
+        && header->entriesOffset >= sizeof(MappedTreeHeader)
+        && header->entriesOffset % MAPPED_BST_ALIGN == 0
+        && header->indexOffset % MAPPED_BST_ALIGN == 0
+        && header->entriesOffset <= header->indexOffset
+        && header->indexOffset <= header->fileSize
+        && header->count <= (header->indexOffset - header->entriesOffset) / sizeof(Entry)
+        && header->count <= (header->fileSize - header->indexOffset) / sizeof(IndexNode);
+    if(!valid){
+        munmap(base, info.st_size);
+        throw std::runtime_error("tree image is corrupt or has different key/value types: " + path);
+    }
+
+    base_ = base;
+    length_ = info.st_size;
+    count_ = header->count;
+    entries_ = reinterpret_cast<const Entry*>(static_cast<const char*>(base) + header->entriesOffset);
+    index_ = reinterpret_cast<const IndexNode*>(static_cast<const char*>(base) + header->indexOffset);
+}
+
+/**
+* Unmaps the image. Iterators and references into it become invalid.
+*/
+template<typename Key, typename Value>
+void MappedTree<Key, Value>::close()
+{
+    if(base_){
+        munmap(base_, length_);
+    }
+    base_ = nullptr;
+    length_ = 0;
+    entries_ = nullptr;
+    index_ = nullptr;
+    count_ = 0;
+}
+
+template<typename Key, typename Value>
+bool MappedTree<Key, Value>::empty() const
+{
+    return count_ == 0;
+}
+
+template<typename Key, typename Value>
+uint64_t MappedTree<Key, Value>::size() const
+{
+    return count_;
+}
+
+/**
+* The entry rank stored in an index node. It comes from the file, so it is
+* checked before it is used as an offset: throws std::runtime_error if it
+* points past the entries section.
+*/
+template<typename Key, typename Value>
+uint64_t MappedTree<Key, Value>::indexEntry(const IndexNode& node) const
+{
+    if(node.entry >= count_){
+        throw std::runtime_error("tree image index is corrupt");
+    }
+    return node.entry;
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::begin() const
+{
+    return entries_;
+}
+
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::end() const
+{
+    return entries_ + count_;
+}
+
+/**
+* Returns an iterator to the entry with key, or end() if there is none.
+*/
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::find(const Key& key) const
+{
+    uint64_t slot = 0;
+    while(slot < count_){
+        const IndexNode& node = index_[slot];
+        if(key < node.key){
+            slot = 2 * slot + 1;
+        }
+        else if(key > node.key){
+            slot = 2 * slot + 2;
+        }
+        else{
+            return entries_ + indexEntry(node);
+        }
+    }
+    return end();
+}
+
+/**
+* Returns an iterator to the first entry whose key is not less than key, so
+* [lower_bound(lo), lower_bound(hi)) is a range scan.
+*/
+template<typename Key, typename Value>
+typename MappedTree<Key, Value>::iterator MappedTree<Key, Value>::lower_bound(const Key& key) const
+{
+    uint64_t slot = 0;
+    uint64_t bound = count_;
+    while(slot < count_){
+        const IndexNode& node = index_[slot];
+        if(node.key < key){
+            slot = 2 * slot + 2;
+        }
+        else{
+            bound = indexEntry(node);
+            slot = 2 * slot + 1;
+        }
+    }
+    return entries_ + bound;
+}
+
+/**
+ * @precondition The key exists in the image
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+const Value& MappedTree<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef MULTI_AVLBST_H
+#define MULTI_AVLBST_H
+
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+// Duplicate keys on an AVLTree, with one node per distinct key:
+//   MultiSetAVLTree<Key>       the node counts the copies of its key
+//   MultiAVLTree<Key, Value>   the node holds its key's values in a
+//                              DuplicateValues list: the first one inline,
+//                              any others in one vector
+// n copies of a key thus cost one node (and, for the multimap, at most one
+// more allocation), not n nodes or a node plus a separate vector.
+//
+// Both answer count(key) with one O(log n) search, and equal_range(key).
+// Iteration is in key order and repeats each key once per copy; for the
+// multimap the values of one key come in insertion order and *it is a
+// std::pair<const Key&, Value&>.
+//
+// The AVLTree base is protected, so the single-valued insert() cannot be
+// called by mistake; the usual search and rebalancing code does the work.
+
+/**
+* Node value of MultiSetAVLTree: how many copies of the key there are.
+*/
+struct DuplicateCount
+{
+    uint64_t count;
+
+    explicit DuplicateCount(uint64_t n = 1) : count(n) { }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // every copy is the key itself
+    template<typename Key>
+    const Key& item(const Key& key, size_t) const
+    {
+        return key;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const DuplicateCount& duplicates)
+{
+    return out << 'x' << duplicates.count;
+}
+
+/**
+* Node value of MultiAVLTree: the values stored under one key. The first is
+* kept inline, so a key without duplicates costs no allocation beyond its
+* node.
+*/
+template<typename Value>
+class DuplicateValues
+{
+public:
+    explicit DuplicateValues(const Value& first) : first_(first) { }
+
+    size_t size() const
+    {
+        return 1 + rest_.size();
+    }
+
+    Value& operator[](size_t i)
+    {
+        return i == 0 ? first_ : rest_[i - 1];
+    }
+
+    const Value& operator[](size_t i) const
+    {
+        return i == 0 ? first_ : rest_[i - 1];
+    }
+
+    void push_back(const Value& value)
+    {
+        rest_.push_back(value);
+    }
+
+    // only while size() > 1: the last value of a key goes with its node
+    void pop_back()
+    {
+        rest_.pop_back();
+    }
+
+    template<typename Key>
+    std::pair<const Key&, Value&> item(const Key& key, size_t i)
+    {
+        return std::pair<const Key&, Value&>(key, (*this)[i]);
+    }
+
+private:
+    Value first_;
+    std::vector<Value> rest_;
+};
+
+template<typename Value>
+std::ostream& operator<<(std::ostream& out, const DuplicateValues<Value>& values)
+{
+    out << '[';
+    for(size_t i = 0; i < values.size(); i++){
+        out << (i ? ", " : "") << values[i];
+    }
+    return out << ']';
+}
+
+/**
+* What MultiSetAVLTree and MultiAVLTree share: an AVLTree whose values are
+* buckets of duplicates (DuplicateCount or DuplicateValues), the element
+* count and the expanding iterator.
+*/
+template<typename Key, typename Bucket>
+class MultiAVLBase : protected AVLTree<Key, Bucket>
+{
+protected:
+    typedef typename BinarySearchTree<Key, Bucket>::iterator NodeIterator;
+
+public:
+    // what *it gives: const Key& for a multiset, pair<const Key&, Value&> for a multimap
+    typedef decltype(std::declval<Bucket&>().item(std::declval<const Key&>(), 0)) reference;
+
+    /**
+    * Walks the tree in key order and each node's bucket from first to last.
+    */
+    class iterator
+    {
+    public:
+        iterator() : index_(0) { }
+
+        reference operator*() const
+        {
+            return node_->second.item(node_->first, index_);
+        }
+
+        const Key& key() const
+        {
+            return node_->first;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return node_ == rhs.node_ && index_ == rhs.index_;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        iterator& operator++()
+        {
+            if(++index_ == node_->second.size()){
+                ++node_;
+                index_ = 0;
+            }
+            return *this;
+        }
+
+    protected:
+        friend class MultiAVLBase<Key, Bucket>;
+        iterator(NodeIterator node) : node_(node), index_(0) { }
+
+        NodeIterator node_;
+        size_t index_;
+    };
+
+    MultiAVLBase();
+
+    size_t size() const;
+    size_t distinctKeys() const;
+    bool empty() const;
+    size_t count(const Key& key) const;
+    size_t erase(const Key& key);
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+
+    using BinarySearchTree<Key, Bucket>::isBalanced;
+    using BinarySearchTree<Key, Bucket>::print;
+
+protected:
+    // elements, every duplicate counted
+    size_t elements_;
+};
+
+template<typename Key, typename Bucket>
+MultiAVLBase<Key, Bucket>::MultiAVLBase() :
+    elements_(0)
+{
+
+}
+
+/**
+* Number of elements, duplicates included.
+*/
+template<typename Key, typename Bucket>
+size_t MultiAVLBase<Key, Bucket>::size() const
+{
+    return elements_;
+}
+
+/**
+* Number of different keys, which is the number of nodes.
+*/
+template<typename Key, typename Bucket>
+size_t MultiAVLBase<Key, Bucket>::distinctKeys() const
+{
+    return BinarySearchTree<Key, Bucket>::size();
+}
+
+template<typename Key, typename Bucket>
+bool MultiAVLBase<Key, Bucket>::empty() const
+{
+    return elements_ == 0;
+}
+
+/**
+* How many copies of key there are, from one search.
+*/
+template<typename Key, typename Bucket>
+size_t MultiAVLBase<Key, Bucket>::count(const Key& key) const
+{
+    Node<Key, Bucket>* n = this->internalFind(key);
+    return n ? n->getValue().size() : 0;
+}
+
+/**
+* Removes every copy of key and returns how many there were.
+*/
+template<typename Key, typename Bucket>
+size_t MultiAVLBase<Key, Bucket>::erase(const Key& key)
+{
+    size_t copies = count(key);
+    if(copies > 0){
+        AVLTree<Key, Bucket>::remove(key);
+        elements_ -= copies;
+    }
+    return copies;
+}
+
+template<typename Key, typename Bucket>
+void MultiAVLBase<Key, Bucket>::clear()
+{
+    BinarySearchTree<Key, Bucket>::clear();
+    elements_ = 0;
+}
+
+template<typename Key, typename Bucket>
+typename MultiAVLBase<Key, Bucket>::iterator MultiAVLBase<Key, Bucket>::begin() const
+{
+    return iterator(BinarySearchTree<Key, Bucket>::begin());
+}
+
+template<typename Key, typename Bucket>
+typename MultiAVLBase<Key, Bucket>::iterator MultiAVLBase<Key, Bucket>::end() const
+{
+    return iterator(BinarySearchTree<Key, Bucket>::end());
+}
+
+/**
+* The first copy of key, or end().
+*/
+template<typename Key, typename Bucket>
+typename MultiAVLBase<Key, Bucket>::iterator MultiAVLBase<Key, Bucket>::find(const Key& key) const
+{
+    return iterator(BinarySearchTree<Key, Bucket>::find(key));
+}
+
+/**
+* All copies of key as [first, second); both are end() if there are none.
+*/
+template<typename Key, typename Bucket>
+std::pair<typename MultiAVLBase<Key, Bucket>::iterator, typename MultiAVLBase<Key, Bucket>::iterator>
+MultiAVLBase<Key, Bucket>::equal_range(const Key& key) const
+{
+    NodeIterator first = BinarySearchTree<Key, Bucket>::find(key);
+    NodeIterator last = first;
+    if(last != BinarySearchTree<Key, Bucket>::end()){
+        ++last;
+    }
+    return std::make_pair(iterator(first), iterator(last));
+}
+
+/**
+* AVL multiset: one node per distinct key, holding a count.
+*/
+template<typename Key>
+class MultiSetAVLTree : public MultiAVLBase<Key, DuplicateCount>
+{
+public:
+    void insert(const Key& key, uint64_t copies = 1);
+    bool eraseOne(const Key& key);
+};
+
+/**
+* Adds copies more of key, with one search and at most one new node.
+*/
+template<typename Key>
+void MultiSetAVLTree<Key>::insert(const Key& key, uint64_t copies)
+{
+    if(copies == 0){
+        return;
+    }
+    Node<Key, DuplicateCount>* parent = nullptr;
+    Node<Key, DuplicateCount>* match = this->searchParent(key, parent);
+    if(match){
+        match->getValue().count += copies;
+    }
+    else{
+        this->attachNode(parent, std::pair<const Key, DuplicateCount>(key, DuplicateCount(copies)));
+    }
+    this->elements_ += copies;
+}
+
+/**
+* Removes one copy of key; returns false if there was none.
+*/
+template<typename Key>
+bool MultiSetAVLTree<Key>::eraseOne(const Key& key)
+{
+    Node<Key, DuplicateCount>* n = this->internalFind(key);
+    if(!n){
+        return false;
+    }
+    if(n->getValue().count > 1){
+        --n->getValue().count;
+        --this->elements_;
+    }
+    else{
+        this->erase(key);
+    }
+    return true;
+}
+
+/**
+* AVL multimap: one node per distinct key, holding all of its values.
+*/
+template<typename Key, typename Value>
+class MultiAVLTree : public MultiAVLBase<Key, DuplicateValues<Value> >
+{
+public:
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    bool eraseOne(const Key& key);
+};
+
+/**
+* Adds a value under its key, after any values already there, with one
+* search and at most one new node.
+*/
+template<typename Key, typename Value>
+void MultiAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Node<Key, DuplicateValues<Value> >* parent = nullptr;
+    Node<Key, DuplicateValues<Value> >* match = this->searchParent(keyValuePair.first, parent);
+    if(match){
+        match->getValue().push_back(keyValuePair.second);
+    }
+    else{
+        this->attachNode(parent, std::pair<const Key, DuplicateValues<Value> >(keyValuePair.first, DuplicateValues<Value>(keyValuePair.second)));
+    }
+    ++this->elements_;
+}
+
+/**
+* Removes the most recently inserted value of key; returns false if key has
+* no values.
+*/
+template<typename Key, typename Value>
+bool MultiAVLTree<Key, Value>::eraseOne(const Key& key)
+{
+    Node<Key, DuplicateValues<Value> >* n = this->internalFind(key);
+    if(!n){
+        return false;
+    }
+    if(n->getValue().size() > 1){
+        n->getValue().pop_back();
+        --this->elements_;
+    }
+    else{
+        this->erase(key);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,685 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst_instances.h"
+#include "bench_workload.h"
+#ifdef PERF_CHECK_LIBPERF
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "libperf.h"
+#endif
+
+using namespace std;
+
+// Performance regression gate (make perf-check).
+//
+// Runs the bst-bench operations on a fixed set of (structure, distribution)
+// rows, trials times each. The trials are interleaved across rows, so a burst
+// of machine noise hits every row alike, and one warm-up trial per row is
+// thrown away. Each row is summarised by its median ns/op and the median
+// absolute deviation (MAD) of the trials, and compared with the same row of
+// a baseline written earlier with --write-baseline.
+//
+// The baseline may come from another machine, and this run may share the CPU
+// with other load, so rows are not compared in absolute nanoseconds. The
+// std::map rows measure the machine rather than our code: for each operation,
+// the std::map/random median of this run divided by the one in the baseline
+// is the machine factor, and a row's expected time is its baseline median
+// times that factor. A row is a regression only when its median is slower
+// than expected by more than both
+//   NOISE_SIGMAS * 1.4826 * sqrt((factor * MAD_baseline)^2 + MAD_now^2
+//                                + (expected * MAD_ref / median_ref)^2)
+//   tolerance * expected (default 10%)
+// so neither a few noisy trials, a noisy reference nor small drift fail the
+// gate. The std::map rows themselves never fail it.
+//
+// Built with -DPERF_CHECK_LIBPERF (make perf-check PERF_COUNTERS=1) it also
+// reads cycles, cache misses and branch misses through libperf from
+// hw4_tests/testing_utils. They are reported per operation and stored in the
+// baseline but do not gate; counters the kernel (or a VM) does not expose are
+// left out.
+//
+// Exit status: 0 no regression, 1 regression, 2 usage or baseline error.
+//
+// usage: ./perf-check-runner [--baseline file | --write-baseline file] [--size n] [--trials n] [--tolerance fraction]
+
+#define PERF_CHECK_SIZE 100000
+#define PERF_CHECK_TRIALS 11
+#define PERF_CHECK_TOLERANCE 0.10
+#define NOISE_SIGMAS 3.0
+
+// scales a MAD to the standard deviation of normally distributed samples
+#define MAD_TO_SIGMA 1.4826
+
+#define COUNTERS 3
+const char* counterNames[COUNTERS] = {"cycles", "cache_misses", "branch_misses"};
+
+#ifdef PERF_CHECK_LIBPERF
+const int libperfCounters[COUNTERS] = {
+    LIBPERF_COUNT_HW_CPU_CYCLES, LIBPERF_COUNT_HW_CACHE_MISSES, LIBPERF_COUNT_HW_BRANCH_MISSES};
+const uint64_t perfEventConfigs[COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+/**
+* libperf_enablecounter() asserts when a counter cannot be opened, so each
+* counter is first tried here with the attributes libperf uses.
+*/
+bool probeCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if(fd < 0){
+        return false;
+    }
+    close(fd);
+    return true;
+}
+#endif
+
+/**
+* The optional hardware counters for the calling thread. A counter that is
+* not built in or not available reads as 0.
+*/
+class HardwareCounters
+{
+public:
+    HardwareCounters()
+    {
+        for(int i = 0; i < COUNTERS; i++){
+            available_[i] = false;
+        }
+#ifdef PERF_CHECK_LIBPERF
+        pd_ = libperf_initialize(-1, -1);
+        for(int i = 0; i < COUNTERS; i++){
+            available_[i] = probeCounter(perfEventConfigs[i]) &&
+                libperf_enablecounter(pd_, libperfCounters[i]) == 0;
+        }
+#endif
+    }
+
+    ~HardwareCounters()
+    {
+#ifdef PERF_CHECK_LIBPERF
+        libperf_close(pd_);
+        //libperf logs to a file named after the thread id; nothing is logged here
+        remove(to_string((long)syscall(SYS_gettid)).c_str());
+#endif
+    }
+
+    bool available(int counter) const
+    {
+        return available_[counter];
+    }
+
+    bool any() const
+    {
+        for(int i = 0; i < COUNTERS; i++){
+            if(available_[i]){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void read(uint64_t values[COUNTERS]) const
+    {
+        for(int i = 0; i < COUNTERS; i++){
+            values[i] = 0;
+#ifdef PERF_CHECK_LIBPERF
+            if(available_[i]){
+                values[i] = libperf_readcounter(pd_, libperfCounters[i]);
+            }
+#endif
+        }
+    }
+
+private:
+#ifdef PERF_CHECK_LIBPERF
+    struct libperf_data* pd_;
+#endif
+    bool available_[COUNTERS];
+};
+
+/**
+* One operation of one trial: time and counter deltas per operation.
+*/
+struct Sample
+{
+    double ns;
+    double counters[COUNTERS];
+};
+
+typedef chrono::steady_clock Clock;
+
+/**
+* Times one phase of a trial. Counters are read outside the timed region.
+*/
+class Phase
+{
+public:
+    Phase(const HardwareCounters& counters) :
+        counters_(counters)
+    {
+        counters_.read(startCounts_);
+        start_ = Clock::now();
+    }
+
+    Sample stop(uint64_t ops)
+    {
+        Clock::time_point end = Clock::now();
+        uint64_t endCounts[COUNTERS];
+        counters_.read(endCounts);
+
+        Sample s;
+        chrono::duration<double, nano> elapsed = end - start_;
+        double perOp = ops ? 1.0 / ops : 0;
+        s.ns = elapsed.count() * perOp;
+        for(int i = 0; i < COUNTERS; i++){
+            s.counters[i] = (endCounts[i] - startCounts_[i]) * perOp;
+        }
+        return s;
+    }
+
+private:
+    const HardwareCounters& counters_;
+    uint64_t startCounts_[COUNTERS];
+    Clock::time_point start_;
+};
+
+// keeps lookups and iteration from being optimized away
+volatile uint64_t sink;
+
+/**
+* One trial: every operation once on a fresh container, in bst-bench order.
+*/
+template<typename Container>
+void runTrial(const Workload& w, const HardwareCounters& counters, Sample samples[OPERATIONS])
+{
+    Container c;
+    uint64_t checksum = 0;
+
+    Phase insert(counters);
+    for(size_t i = 0; i < w.inserts.size(); i++){
+        insertKey(c, w.inserts[i], i);
+    }
+    samples[0] = insert.stop(w.inserts.size());
+
+    Phase findHit(counters);
+    for(size_t i = 0; i < w.hits.size(); i++){
+        checksum += contains(c, w.hits[i]);
+    }
+    samples[1] = findHit.stop(w.hits.size());
+
+    Phase findMiss(counters);
+    for(size_t i = 0; i < w.misses.size(); i++){
+        checksum += contains(c, w.misses[i]);
+    }
+    samples[2] = findMiss.stop(w.misses.size());
+
+    Phase iterate(counters);
+    uint64_t entries = 0;
+    for(typename Container::iterator it = c.begin(); it != c.end(); ++it){
+        checksum += it->second;
+        ++entries;
+    }
+    samples[4] = iterate.stop(entries);
+
+    Phase remove(counters);
+    for(size_t i = 0; i < w.inserts.size(); i++){
+        removeKey(c, w.inserts[i]);
+    }
+    samples[3] = remove.stop(w.inserts.size());
+
+    //clear needs a full container again; the refill is not timed
+    for(size_t i = 0; i < w.inserts.size(); i++){
+        insertKey(c, w.inserts[i], i);
+    }
+    Phase clear(counters);
+    c.clear();
+    samples[5] = clear.stop(entries);
+
+    sink = checksum;
+}
+
+/**
+* The rows perf-check measures. The plain BST is only run on random keys,
+* where it does not degenerate.
+*/
+struct Config
+{
+    const char* structure;
+    const char* distribution;
+};
+
+const Config configs[] = {
+    {"AVLTree", "random"},
+    {"AVLTree", "sorted"},
+    {"AVLTree", "zipf"},
+    {"BinarySearchTree", "random"},
+    {"std::map", "random"}
+};
+const size_t CONFIGS = sizeof(configs) / sizeof(configs[0]);
+
+void runConfig(const Config& config, const Workload& w, const HardwareCounters& counters, Sample samples[OPERATIONS])
+{
+    string structure = config.structure;
+    if(structure == "AVLTree"){
+        runTrial<AVLTree<uint64_t, uint64_t> >(w, counters, samples);
+    }
+    else if(structure == "BinarySearchTree"){
+        runTrial<BinarySearchTree<uint64_t, uint64_t> >(w, counters, samples);
+    }
+    else{
+        runTrial<map<uint64_t, uint64_t> >(w, counters, samples);
+    }
+}
+
+/**
+* Summary of one (structure, distribution, operation) row, measured or read
+* back from a baseline.
+*/
+struct Row
+{
+    string structure;
+    string distribution;
+    string operation;
+    double medianNs;
+    double madNs;
+    bool hasCounter[COUNTERS];
+    double counters[COUNTERS];
+
+    string id() const
+    {
+        return structure + "/" + distribution + "/" + operation;
+    }
+};
+
+double median(vector<double> values)
+{
+    if(values.empty()){
+        return 0;
+    }
+    size_t mid = values.size() / 2;
+    nth_element(values.begin(), values.begin() + mid, values.end());
+    double upper = values[mid];
+    if(values.size() % 2){
+        return upper;
+    }
+    double lower = *max_element(values.begin(), values.begin() + mid);
+    return (lower + upper) / 2;
+}
+
+double medianAbsoluteDeviation(const vector<double>& values, double center)
+{
+    vector<double> deviations;
+    for(size_t i = 0; i < values.size(); i++){
+        deviations.push_back(fabs(values[i] - center));
+    }
+    return median(deviations);
+}
+
+Row summarize(const Config& config, int op, const vector<Sample>& trials, const HardwareCounters& counters)
+{
+    Row row;
+    row.structure = config.structure;
+    row.distribution = config.distribution;
+    row.operation = operationNames[op];
+
+    vector<double> ns;
+    for(size_t t = 0; t < trials.size(); t++){
+        ns.push_back(trials[t].ns);
+    }
+    row.medianNs = median(ns);
+    row.madNs = medianAbsoluteDeviation(ns, row.medianNs);
+
+    for(int i = 0; i < COUNTERS; i++){
+        row.hasCounter[i] = counters.available(i);
+        vector<double> values;
+        for(size_t t = 0; t < trials.size(); t++){
+            values.push_back(trials[t].counters[i]);
+        }
+        row.counters[i] = median(values);
+    }
+    return row;
+}
+
+void writeBaseline(const string& path, uint64_t size, int trials, const vector<Row>& rows)
+{
+    ofstream out(path.c_str());
+    if(!out){
+        throw runtime_error("cannot write " + path);
+    }
+    out << "{\n  \"benchmark\": \"perf-check\",\n  \"size\": " << size
+        << ",\n  \"trials\": " << trials << ",\n  \"results\": [";
+    for(size_t r = 0; r < rows.size(); r++){
+        const Row& row = rows[r];
+        out << (r ? ",\n" : "\n");
+        out << "    {\"structure\": \"" << row.structure << "\", \"distribution\": \"" << row.distribution
+            << "\", \"operation\": \"" << row.operation << "\", \"median_ns\": " << row.medianNs
+            << ", \"mad_ns\": " << row.madNs;
+        for(int i = 0; i < COUNTERS; i++){
+            if(row.hasCounter[i]){
+                out << ", \"" << counterNames[i] << "\": " << row.counters[i];
+            }
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}" << endl;
+    if(!out){
+        throw runtime_error("cannot write " + path);
+    }
+}
+
+/**
+* Finds "key": value on a line and returns the value without quotes. The
+* baseline is written by writeBaseline(), one result per line, so this is
+* all the JSON parsing it needs.
+*/
+bool jsonField(const string& line, const string& key, string& value)
+{
+    string pattern = "\"" + key + "\": ";
+    size_t pos = line.find(pattern);
+    if(pos == string::npos){
+        return false;
+    }
+    pos += pattern.size();
+    if(pos < line.size() && line[pos] == '"'){
+        size_t end = line.find('"', pos + 1);
+        value = line.substr(pos + 1, end - pos - 1);
+    }
+    else{
+        size_t end = line.find_first_of(",}", pos);
+        value = line.substr(pos, end - pos);
+    }
+    return true;
+}
+
+double jsonNumber(const string& line, const string& key)
+{
+    string value;
+    if(!jsonField(line, key, value)){
+        throw runtime_error("baseline row without \"" + key + "\": " + line);
+    }
+    return strtod(value.c_str(), nullptr);
+}
+
+map<string, Row> readBaseline(const string& path, uint64_t& size)
+{
+    ifstream in(path.c_str());
+    if(!in){
+        throw runtime_error("cannot read " + path + " (make perf-baseline writes it)");
+    }
+    map<string, Row> rows;
+    size = 0;
+    string line;
+    while(getline(in, line)){
+        string value;
+        if(!jsonField(line, "structure", value)){
+            if(jsonField(line, "size", value)){
+                size = strtoull(value.c_str(), nullptr, 10);
+            }
+            continue;
+        }
+        Row row;
+        row.structure = value;
+        if(!jsonField(line, "distribution", row.distribution) || !jsonField(line, "operation", row.operation)){
+            throw runtime_error("malformed baseline row: " + line);
+        }
+        row.medianNs = jsonNumber(line, "median_ns");
+        row.madNs = jsonNumber(line, "mad_ns");
+        for(int i = 0; i < COUNTERS; i++){
+            row.hasCounter[i] = jsonField(line, counterNames[i], value);
+            row.counters[i] = row.hasCounter[i] ? strtod(value.c_str(), nullptr) : 0;
+        }
+        rows[row.id()] = row;
+    }
+    if(rows.empty()){
+        throw runtime_error(path + " holds no results");
+    }
+    return rows;
+}
+
+string percent(double now, double before)
+{
+    ostringstream out;
+    out << showpos << fixed << setprecision(1) << (before > 0 ? (now - before) * 100 / before : 0) << "%";
+    return out.str();
+}
+
+// the rows every other row is normalized against, one per operation
+#define REFERENCE_STRUCTURE "std::map"
+#define REFERENCE_DISTRIBUTION "random"
+
+/**
+* How much slower this run's machine is than the baseline's for operation,
+* measured on the reference rows (1 if either run lacks them). relativeNoise
+* is set to the reference's MAD relative to its median in this run.
+*/
+double machineFactor(const vector<Row>& rows, const map<string, Row>& baseline, const string& operation, double& relativeNoise)
+{
+    relativeNoise = 0;
+    string id = string(REFERENCE_STRUCTURE) + "/" + REFERENCE_DISTRIBUTION + "/" + operation;
+    map<string, Row>::const_iterator base = baseline.find(id);
+    for(size_t r = 0; r < rows.size(); r++){
+        if(rows[r].id() == id && base != baseline.end() && base->second.medianNs > 0 && rows[r].medianNs > 0){
+            relativeNoise = rows[r].madNs / rows[r].medianNs;
+            return rows[r].medianNs / base->second.medianNs;
+        }
+    }
+    return 1;
+}
+
+/**
+* Prints the diff table and returns the number of regressions.
+*/
+int compare(const vector<Row>& rows, const map<string, Row>& baseline, double tolerance, const HardwareCounters& counters)
+{
+    cout << "machine factor (this run / baseline, " << REFERENCE_STRUCTURE << " " << REFERENCE_DISTRIBUTION << "):";
+    for(int op = 0; op < OPERATIONS; op++){
+        double relativeNoise = 0;
+        cout << " " << operationNames[op] << " x" << fixed << setprecision(2)
+             << machineFactor(rows, baseline, operationNames[op], relativeNoise);
+    }
+    cout << endl;
+
+    cout << left << setw(18) << "structure" << setw(9) << "keys" << setw(11) << "operation" << right
+         << setw(11) << "base ns" << setw(11) << "expect ns" << setw(11) << "now ns" << setw(9) << "change"
+         << setw(10) << "noise ns" << "  " << left << setw(12) << "status" << right;
+    for(int i = 0; i < COUNTERS; i++){
+        if(counters.available(i)){
+            cout << setw(24) << string(counterNames[i]) + "/op";
+        }
+    }
+    cout << endl;
+
+    int regressions = 0;
+    for(size_t r = 0; r < rows.size(); r++){
+        const Row& now = rows[r];
+        bool reference = now.structure == REFERENCE_STRUCTURE;
+        map<string, Row>::const_iterator found = baseline.find(now.id());
+
+        cout << left << setw(18) << now.structure << setw(9) << now.distribution << setw(11) << now.operation
+             << right << fixed << setprecision(2);
+        string status;
+        if(found == baseline.end()){
+            cout << setw(11) << "-" << setw(11) << "-" << setw(11) << now.medianNs << setw(9) << "-" << setw(10) << "-";
+            status = "new";
+        }
+        else if(reference){
+            //the reference defines the machine factor, so it only shows how the machine moved
+            cout << setw(11) << found->second.medianNs << setw(11) << "-" << setw(11) << now.medianNs
+                 << setw(9) << percent(now.medianNs, found->second.medianNs) << setw(10) << "-";
+            status = "reference";
+        }
+        else{
+            const Row& base = found->second;
+            double relativeNoise = 0;
+            double factor = machineFactor(rows, baseline, now.operation, relativeNoise);
+            double expected = base.medianNs * factor;
+            double baseMad = base.madNs * factor;
+            double noise = MAD_TO_SIGMA * sqrt(baseMad * baseMad + now.madNs * now.madNs
+                + (expected * relativeNoise) * (expected * relativeNoise));
+            double threshold = max(NOISE_SIGMAS * noise, tolerance * expected);
+            double delta = now.medianNs - expected;
+            cout << setw(11) << base.medianNs << setw(11) << expected << setw(11) << now.medianNs
+                 << setw(9) << percent(now.medianNs, expected) << setw(10) << noise;
+            if(delta > threshold){
+                status = "REGRESSION";
+                ++regressions;
+            }
+            else if(-delta > threshold){
+                status = "faster";
+            }
+            else{
+                status = "ok";
+            }
+        }
+        cout << "  " << left << setw(12) << status << right;
+
+        for(int i = 0; i < COUNTERS; i++){
+            if(!counters.available(i)){
+                continue;
+            }
+            ostringstream cell;
+            cell << fixed << setprecision(2) << now.counters[i];
+            if(found != baseline.end() && found->second.hasCounter[i]){
+                cell << " (" << percent(now.counters[i], found->second.counters[i]) << ")";
+            }
+            cout << setw(24) << cell.str();
+        }
+        cout << endl;
+    }
+
+    return regressions;
+}
+
+int usage(const char* program)
+{
+    cerr << "usage: " << program << " [--baseline file | --write-baseline file] [--size n] [--trials n] [--tolerance fraction]" << endl;
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    string baselinePath;
+    string writePath;
+    uint64_t size = PERF_CHECK_SIZE;
+    int trials = PERF_CHECK_TRIALS;
+    double tolerance = PERF_CHECK_TOLERANCE;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(i + 1 == argc){
+            return usage(argv[0]);
+        }
+        if(arg == "--baseline"){
+            baselinePath = argv[++i];
+        }
+        else if(arg == "--write-baseline"){
+            writePath = argv[++i];
+        }
+        else if(arg == "--size"){
+            size = strtoull(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--trials"){
+            trials = atoi(argv[++i]);
+        }
+        else if(arg == "--tolerance"){
+            tolerance = atof(argv[++i]);
+        }
+        else{
+            return usage(argv[0]);
+        }
+    }
+    if(size == 0 || trials <= 0 || tolerance < 0 || baselinePath.empty() == writePath.empty()){
+        return usage(argv[0]);
+    }
+
+    try{
+        map<string, Row> baseline;
+        if(!baselinePath.empty()){
+            uint64_t baselineSize = 0;
+            baseline = readBaseline(baselinePath, baselineSize);
+            if(baselineSize != size){
+                cerr << baselinePath << " was written with --size " << baselineSize << endl;
+                return 2;
+            }
+        }
+
+        HardwareCounters counters;
+        cerr << "perf-check: " << size << " keys, " << trials << " trials, hardware counters:";
+        for(int i = 0; i < COUNTERS; i++){
+            cerr << " " << counterNames[i] << (counters.available(i) ? "" : " (unavailable)");
+        }
+        cerr << endl;
+
+        map<string, Workload> workloads;
+        for(size_t c = 0; c < CONFIGS; c++){
+            if(workloads.find(configs[c].distribution) == workloads.end()){
+                workloads[configs[c].distribution] = makeWorkload(configs[c].distribution, size);
+            }
+        }
+
+        //samples[c * OPERATIONS + op] holds one Sample per trial
+        vector<vector<Sample> > samples(CONFIGS * OPERATIONS);
+        for(int trial = -1; trial < trials; trial++){
+            for(size_t c = 0; c < CONFIGS; c++){
+                Sample trialSamples[OPERATIONS];
+                runConfig(configs[c], workloads[configs[c].distribution], counters, trialSamples);
+                //trial -1 warms up caches, the allocator and the CPU clock
+                if(trial < 0){
+                    continue;
+                }
+                for(int op = 0; op < OPERATIONS; op++){
+                    samples[c * OPERATIONS + op].push_back(trialSamples[op]);
+                }
+            }
+        }
+
+        vector<Row> rows;
+        for(size_t c = 0; c < CONFIGS; c++){
+            for(int op = 0; op < OPERATIONS; op++){
+                rows.push_back(summarize(configs[c], op, samples[c * OPERATIONS + op], counters));
+            }
+        }
+
+        if(!writePath.empty()){
+            writeBaseline(writePath, size, trials, rows);
+            cerr << "perf-check: wrote " << rows.size() << " rows to " << writePath << endl;
+            return 0;
+        }
+
+        int regressions = compare(rows, baseline, tolerance, counters);
+        if(regressions > 0){
+            cout << "perf-check: " << regressions << " regression" << (regressions > 1 ? "s" : "")
+                 << " against " << baselinePath << endl;
+            return 1;
+        }
+        cout << "perf-check: no regressions against " << baselinePath << endl;
+        return 0;
+    }
+    catch(const exception& e){
+        cerr << "perf-check: " << e.what() << endl;
+        return 2;
+    }
+}
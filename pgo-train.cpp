@@ -0,0 +1,133 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include "bst_instances.h"
+#include "bench_workload.h"
+
+using namespace std;
+
+// Training driver for the profile-guided build (make pgo). It runs the
+// instrumented tree code in bst_instances.o through the mixes the trees see
+// in use, so the profile knows which branches and loops are hot:
+//   growth        random inserts into an empty tree
+//   steady state  finds (half of them misses), inserts, removes and short
+//                 in-order scans, interleaved
+//   appends       ascending keys past the largest one (AVLTree only; they
+//                 turn the plain BST into a list)
+//   full scan     one in-order walk of the whole tree
+//   drain         every key removed in random order
+// Its key streams are not the benchmarks' own, so the profile describes the
+// operations rather than the measurement.
+//
+// usage: ./pgo-train [size]   (default 200000)
+
+#define STEADY_OPS_PER_KEY 4
+#define SCAN_LENGTH 16
+
+// keeps lookups and iteration from being optimized away
+volatile uint64_t sink;
+
+template<typename Tree>
+void scan(const Tree& tree, uint64_t key, int steps, uint64_t& checksum)
+{
+    typename Tree::iterator it = tree.find(key);
+    for(int i = 0; i < steps && it != tree.end(); i++, ++it){
+        checksum += it->second;
+    }
+}
+
+/**
+* Runs the mixes above on one tree and returns false if it ends up holding
+* anything but the keys put into it.
+*/
+template<typename Tree>
+bool train(uint64_t size, bool appends, uint64_t seed)
+{
+    Tree tree;
+    vector<uint64_t> keys;
+    mt19937_64 rng(seed);
+    uint64_t next = 0;
+    uint64_t checksum = 0;
+
+    for(uint64_t i = 0; i < size; i++){
+        keys.push_back(mix(seed + next++));
+        insertKey(tree, keys.back(), i);
+    }
+
+    for(uint64_t i = 0; i < STEADY_OPS_PER_KEY * size; i++){
+        uint64_t r = rng();
+        uint64_t pick = keys.empty() ? 0 : (r >> 8) % keys.size();
+        switch(r % 10){
+            case 0: case 1: case 2:
+                checksum += !keys.empty() && contains(tree, keys[pick]);
+                break;
+            case 3: case 4:
+                checksum += contains(tree, mix(~r));
+                break;
+            case 5: case 6:
+                keys.push_back(mix(seed + next++));
+                insertKey(tree, keys.back(), i);
+                break;
+            case 7: case 8:
+                if(!keys.empty()){
+                    removeKey(tree, keys[pick]);
+                    keys[pick] = keys.back();
+                    keys.pop_back();
+                }
+                break;
+            default:
+                if(!keys.empty()){
+                    scan(tree, keys[pick], SCAN_LENGTH, checksum);
+                }
+                break;
+        }
+    }
+
+    if(appends){
+        uint64_t key = keys.empty() ? 0 : *max_element(keys.begin(), keys.end());
+        for(uint64_t i = 0; i < size / 4 && key < UINT64_MAX; i++){
+            keys.push_back(++key);
+            insertKey(tree, key, i);
+        }
+    }
+
+    uint64_t entries = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+        checksum += it->second;
+        ++entries;
+    }
+
+    shuffle(keys.begin(), keys.end(), rng);
+    for(size_t i = 0; i < keys.size(); i++){
+        removeKey(tree, keys[i]);
+    }
+    sink = checksum;
+    return entries == keys.size() && tree.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t size = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    if(size == 0){
+        cerr << "usage: " << argv[0] << " [size]" << endl;
+        return 1;
+    }
+
+    bool ok = true;
+    //small trees stay in cache, large ones do not; train on both
+    for(uint64_t n = 1000; n <= size; n *= 10){
+        ok = train<AVLTree<uint64_t, uint64_t> >(n, true, n) && ok;
+        ok = train<BinarySearchTree<uint64_t, uint64_t> >(n, false, n + 1) && ok;
+    }
+    ok = train<AVLTree<uint64_t, uint64_t> >(size, true, size) && ok;
+    ok = train<BinarySearchTree<uint64_t, uint64_t> >(size, false, size + 1) && ok;
+
+    if(!ok){
+        cerr << "pgo-train: a tree lost or kept keys it should not have" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -13,54 +13,63 @@
 // maximum depth of tree to actually print.
 #define PPBST_MAX_HEIGHT 6
 
-// Returns the node's distance from the given root.
-// 1 means that it is the root.
-// Returns -1 (not found) if the distance is more than PPBST_MAX_HEIGHT,
-// or -2 if the tree is inconsistent.
+// Lays out the top levels of the tree at root in one breadth-first pass.
+// Overwrites slots with the nodes, heap-style: the node at depth d
+// (0 = root) and horizontal position p is slots[2^d - 1 + p], and the
+// children of slots[i] are slots[2i + 1] and slots[2i + 2], with nullptr
+// where there is no node. Stops after maxLevels levels, so broken
+// (cyclic) trees cannot loop, and the work is proportional to the area
+// printed rather than to the size of the tree.
+// Returns the number of levels that hold nodes; sets clipped if there are
+// nodes below the last level laid out.
 template<typename Key, typename Value>
-int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
+uint32_t layoutTopLevels(Node<Key, Value> * root, uint32_t maxLevels, std::vector<Node<Key, Value> *> & slots, bool & clipped)
 {
-    int dist = 1;
+    slots.assign(1, root);
+    clipped = false;
 
-    while(node != root)
+    uint32_t levels = 0;
+    size_t levelStart = 0;
+    bool levelHasNodes = (root != nullptr);
+
+    while(levelHasNodes)
     {
-        if(node == nullptr)
+        ++levels;
+        size_t levelEnd = slots.size();
+        levelHasNodes = false;
+
+        for(size_t slot = levelStart; slot < levelEnd; ++slot)
         {
-            return -2;
-        }
+            Node<Key, Value> * left = nullptr;
+            Node<Key, Value> * right = nullptr;
+            if(slots[slot] != nullptr)
+            {
+                left = slots[slot]->getLeft();
+                right = slots[slot]->getRight();
+            }
+            if(left != nullptr || right != nullptr)
+            {
+                levelHasNodes = true;
+            }
 
-        ++dist;
-        node = node->getParent();
+            if(levels < maxLevels)
+            {
+                slots.push_back(left);
+                slots.push_back(right);
+            }
+        }
 
-        if(dist > PPBST_MAX_HEIGHT)
+        if(levels == maxLevels)
         {
-            return -1;
+            clipped = levelHasNodes;
+            break;
         }
+        levelStart = levelEnd;
     }
 
-    return dist;
-}
-
-// Returns the height of the subtree at root.
-// Uses recursion, not height values, so it is bulletproof
-// against incorrect heights.
-// Stops recursing after PPBST_MAX_HEIGHT calls.
-template<typename Key, typename Value>
-int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
-{
-    if(root == nullptr)
-    {
-        return 0;
-    }
-
-    if(recursionDepth > PPBST_MAX_HEIGHT)
-    {
-        // bail out to prevent infinite loops on bad trees
-        return 0;
-    }
-
-    return std::max(getSubtreeHeight(root->getLeft(), recursionDepth + 1),
-                    getSubtreeHeight(root->getRight(), recursionDepth + 1)) + 1;
+    // drop the empty level past the last one laid out
+    slots.resize(((size_t)1 << levels) - 1);
+    return levels;
 }
 
 /* Function to prettily print a BST out to the terminal.
@@ -109,18 +118,13 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
     // save initial cout state (from https://stackoverflow.com/questions/2273330/restore-the-state-of-stdcout-after-manipulating-it)
     std::ios::fmtflags origCoutState(std::cout.flags());
 
-    // do some initial calculations
+    // lay out the printed levels
     // ----------------------------------------------------------------------
-    uint32_t printedTreeHeight = getSubtreeHeight(root);
+    std::vector<Node<Key, Value> *> slots;
     bool clippedFinalElements = false;
 
     // with the width of a standard terminal, we can only print 2^5 = 32 elements
-    if(printedTreeHeight > PPBST_MAX_HEIGHT)
-    {
-        printedTreeHeight = PPBST_MAX_HEIGHT;
-        clippedFinalElements = true;
-
-    }
+    uint32_t printedTreeHeight = layoutTopLevels(root, PPBST_MAX_HEIGHT, slots, clippedFinalElements);
 
     uint16_t finalRowNumElements = (uint16_t)std::pow(2, printedTreeHeight - 1);
     uint16_t finalRowWidth = ((uint16_t)(ELEMENT_WIDTH * finalRowNumElements - PADDING));
@@ -129,17 +133,20 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
     // ----------------------------------------------------------------------
     std::map<Key, uint8_t> valuePlaceholders;
 
-    uint8_t nextPlaceHolderVal = 1;
-    for(typename BinarySearchTree<Key, Value>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
+    for(size_t slot = 0; slot < slots.size(); ++slot)
     {
-
-        if(getNodeDepth(*this, root, treeIter.current_) != -1)
+        if(slots[slot] != nullptr)
         {
-            // note; the iterator will traverse in sorted order so values should get the same placeholders between
-            // different calls as long as the tree is the same
-            valuePlaceholders.insert(std::make_pair(treeIter->first, nextPlaceHolderVal++));
+            valuePlaceholders.insert(std::make_pair(slots[slot]->getKey(), 0));
         }
+    }
 
+    // number them in key order, so values should get the same placeholders between
+    // different calls as long as the tree is the same
+    uint8_t nextPlaceHolderVal = 1;
+    for(typename std::map<Key, uint8_t>::iterator placeholdersIter = valuePlaceholders.begin(); placeholdersIter != valuePlaceholders.end(); ++placeholdersIter)
+    {
+        placeholdersIter->second = nextPlaceHolderVal++;
     }
 
     // print tree
@@ -150,13 +157,13 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
     uint16_t elementPadding = ((uint16_t)(finalRowWidth - 2));
 
-    std::vector<Node<Key, Value> *> currRowNodes; // contains the 2^levelIndex nodes in this row, or nullptr to mark nonexistant nodes
-    currRowNodes.push_back(root);
-
     for(size_t levelIndex = 0; levelIndex < printedTreeHeight; ++levelIndex)
     {
         uint16_t numElements =(uint16_t)std::pow(2, levelIndex);
 
+        // the 2^levelIndex nodes in this row, or nullptr to mark nonexistant nodes
+        Node<Key, Value> * const * currRowNodes = &slots[numElements - 1];
+
         // print elements themselves
         std::cout << std::string(firstElementMargin, ' ');
         for(size_t elementIndex = 0; elementIndex < numElements; ++elementIndex)
@@ -182,24 +189,6 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
         elementPadding = ((uint16_t)((elementPadding - BOX_WIDTH) / 2));
         firstElementMargin = ((uint16_t)(firstElementMargin - (elementPadding / 2 + 2)));
 
-        // calculate node lists for next iteration
-        // ---------------------------------------------------------------------
-        std::vector<Node<Key, Value> *> prevRowNodes = currRowNodes;
-        currRowNodes.clear();
-        for(typename std::vector<Node<Key, Value> *>::iterator prevRowIter = prevRowNodes.begin(); prevRowIter != prevRowNodes.end() ; ++prevRowIter)
-        {
-            if(*prevRowIter == nullptr)
-            {
-                currRowNodes.push_back(nullptr);
-                currRowNodes.push_back(nullptr);
-            }
-            else
-            {
-                currRowNodes.push_back((*prevRowIter)->getLeft());
-                currRowNodes.push_back((*prevRowIter)->getRight());
-            }
-        }
-
         // print connecting lines
         // ---------------------------------------------------------------------
         if(levelIndex < printedTreeHeight - 1)
@@ -207,9 +196,9 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
             // start above middle side of first element
             std::cout << std::string(firstElementMargin + 2, ' ');
 
-            for(size_t prevRowElementIndex = 0; prevRowElementIndex < prevRowNodes.size(); ++prevRowElementIndex)
+            for(size_t elementIndex = 0; elementIndex < numElements; ++elementIndex)
             {
-                Node<Key, Value> * currNode = prevRowNodes[prevRowElementIndex];
+                Node<Key, Value> * currNode = currRowNodes[elementIndex];
 
                 // print first branch
                 if(currNode == nullptr || currNode->getLeft() == nullptr)
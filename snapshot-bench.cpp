@@ -0,0 +1,127 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Compares restoring an AVLTree from a binary snapshot (linear balanced build)
+// against replaying one insert() per record, and the size and load time of
+// the delta/varint export against the plain snapshot.
+//
+// usage: ./snapshot-bench [numRecords] [snapshotPath]
+
+double msSince(chrono::steady_clock::time_point start)
+{
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+bool sameContents(AVLTree<uint64_t, uint64_t>& expected, AVLTree<uint64_t, uint64_t>& actual)
+{
+    AVLTree<uint64_t, uint64_t>::iterator a = expected.begin();
+    AVLTree<uint64_t, uint64_t>::iterator b = actual.begin();
+    for(; a != expected.end() && b != actual.end(); ++a, ++b){
+        if(a->first != b->first || a->second != b->second){
+            return false;
+        }
+    }
+    return a == expected.end() && b == actual.end() && actual.isBalanced();
+}
+
+long fileSize(const char* path)
+{
+    ifstream in(path, ios::binary | ios::ate);
+    return (long)in.tellg();
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char* path = argc > 2 ? argv[2] : "snapshot-bench.tmp";
+    if(n <= 0){
+        cerr << "usage: " << argv[0] << " [numRecords] [snapshotPath]" << endl;
+        return 1;
+    }
+
+    // records arrive in random order, like rows read back from a log
+    vector<uint64_t> keys(n);
+    for(int i = 0; i < n; i++){
+        keys[i] = (uint64_t)i * 7;
+    }
+    shuffle(keys.begin(), keys.end(), mt19937_64(42));
+
+    AVLTree<uint64_t, uint64_t> source;
+    for(int i = 0; i < n; i++){
+        source.insert(make_pair(keys[i], keys[i] + 1));
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        ofstream out(path, ios::binary);
+        source.save(out);
+    }
+    double saveMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    AVLTree<uint64_t, uint64_t> loaded;
+    {
+        ifstream in(path, ios::binary);
+        loaded.load(in);
+    }
+    double loadMs = msSince(start);
+    long snapshotBytes = fileSize(path);
+
+    start = chrono::steady_clock::now();
+    {
+        ofstream out(path, ios::binary);
+        source.saveVarint(out);
+    }
+    double saveVarintMs = msSince(start);
+    long varintBytes = fileSize(path);
+
+    start = chrono::steady_clock::now();
+    AVLTree<uint64_t, uint64_t> varintLoaded;
+    {
+        ifstream in(path, ios::binary);
+        varintLoaded.loadVarint(in);
+    }
+    double loadVarintMs = msSince(start);
+
+    // replay reads the same records but inserts them one by one
+    start = chrono::steady_clock::now();
+    AVLTree<uint64_t, uint64_t> replayed;
+    for(int i = 0; i < n; i++){
+        replayed.insert(make_pair(keys[i], keys[i] + 1));
+    }
+    double replayMs = msSince(start);
+
+    // check the loaded tree against the source
+    bool matches = sameContents(source, loaded) && sameContents(source, varintLoaded);
+    remove(path);
+
+    cout << "AVLTree<uint64_t, uint64_t>, " << n << " records" << endl;
+    cout << fixed << setprecision(1);
+    cout << "save            " << setw(10) << saveMs << " ms" << endl;
+    cout << "load            " << setw(10) << loadMs << " ms" << endl;
+    cout << "replay inserts  " << setw(10) << replayMs << " ms" << endl;
+    cout << "load speedup    " << setw(10) << replayMs / loadMs << " x" << endl;
+    cout << "save varint     " << setw(10) << saveVarintMs << " ms" << endl;
+    cout << "load varint     " << setw(10) << loadVarintMs << " ms" << endl;
+    cout << "snapshot size   " << setw(10) << snapshotBytes / 1024.0 << " KiB" << endl;
+    cout << "varint size     " << setw(10) << varintBytes / 1024.0 << " KiB" << endl;
+    cout << "size ratio      " << setw(10) << (double)snapshotBytes / varintBytes << " x" << endl;
+    if(!matches){
+        cout << "ERROR: loaded tree does not match the source" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#ifndef SNAPSHOT_BST_H
+#define SNAPSHOT_BST_H
+
+// BST binary snapshots: BinarySearchTree::save() / load()
+//
+// Format (version 1, native byte order):
+//   "BSTS"              4-byte magic
+//   uint32_t version
+//   uint64_t count      number of entries
+//   blocks              each block is a uint32_t byte length followed by that
+//                       many bytes; a zero length ends the snapshot
+//
+// The concatenated block payloads hold the entries in increasing key order,
+// each one a key followed by its value, encoded by SnapshotSerializer<Key>
+// and SnapshotSerializer<Value>. Entries may straddle block boundaries.
+// Blocks let both sides move data in large chunks while load() still never
+// reads past the end of the snapshot.
+
+#define SNAPSHOT_BST_VERSION 1
+#define SNAPSHOT_BST_BLOCK_SIZE ((size_t)1 << 20)
+
+/**
+* Buffers snapshot payload bytes and writes them out as length-prefixed blocks.
+*/
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(std::ostream& out) :
+        out_(out),
+        buffer_(SNAPSHOT_BST_BLOCK_SIZE),
+        used_(0),
+        written_(0)
+    {
+
+    }
+
+    void write(const void* data, size_t length)
+    {
+        written_ += length;
+
+        //fast path: the bytes fit in the current block
+        if(length <= buffer_.size() - used_){
+            std::memcpy(buffer_.data() + used_, data, length);
+            used_ += length;
+            return;
+        }
+
+        const char* bytes = static_cast<const char*>(data);
+        while(length > 0){
+            size_t chunk = std::min(length, buffer_.size() - used_);
+            std::memcpy(buffer_.data() + used_, bytes, chunk);
+            used_ += chunk;
+            bytes += chunk;
+            length -= chunk;
+            if(used_ == buffer_.size()){
+                flushBlock();
+            }
+        }
+    }
+
+    void writeByte(uint8_t byte)
+    {
+        if(used_ == buffer_.size()){
+            flushBlock();
+        }
+        buffer_[used_++] = (char)byte;
+        ++written_;
+    }
+
+    // payload bytes written so far, not counting block framing
+    uint64_t written() const
+    {
+        return written_;
+    }
+
+    // writes any buffered bytes plus the terminating empty block
+    void finish()
+    {
+        flushBlock();
+        uint32_t end = 0;
+        out_.write(reinterpret_cast<const char*>(&end), sizeof(end));
+        if(!out_){
+            throw std::runtime_error("snapshot write failed");
+        }
+    }
+
+private:
+    void flushBlock()
+    {
+        if(used_ == 0){
+            return;
+        }
+        uint32_t length = (uint32_t)used_;
+        out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out_.write(buffer_.data(), used_);
+        used_ = 0;
+    }
+
+    std::ostream& out_;
+    std::vector<char> buffer_;
+    size_t used_;
+    uint64_t written_;
+};
+
+/**
+* Reads snapshot payload bytes one whole block at a time.
+*/
+class SnapshotReader
+{
+public:
+    SnapshotReader(std::istream& in) :
+        in_(in),
+        pos_(0),
+        ended_(false)
+    {
+
+    }
+
+    void read(void* data, size_t length)
+    {
+        //fast path: the bytes are all in the current block
+        if(length <= buffer_.size() - pos_){
+            std::memcpy(data, buffer_.data() + pos_, length);
+            pos_ += length;
+            return;
+        }
+
+        char* bytes = static_cast<char*>(data);
+        while(length > 0){
+            if(pos_ == buffer_.size()){
+                nextBlock();
+            }
+            size_t chunk = std::min(length, buffer_.size() - pos_);
+            std::memcpy(bytes, buffer_.data() + pos_, chunk);
+            pos_ += chunk;
+            bytes += chunk;
+            length -= chunk;
+        }
+    }
+
+    uint8_t readByte()
+    {
+        if(pos_ == buffer_.size()){
+            nextBlock();
+        }
+        return (uint8_t)buffer_[pos_++];
+    }
+
+    // consumes the terminating empty block, which must come next
+    void finish()
+    {
+        if(pos_ != buffer_.size()){
+            throw std::runtime_error("snapshot has trailing data");
+        }
+        if(!ended_){
+            nextBlock(true);
+        }
+    }
+
+private:
+    void nextBlock(bool expectEnd = false)
+    {
+        if(ended_){
+            throw std::runtime_error("snapshot is truncated");
+        }
+        uint32_t length = 0;
+        in_.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if(!in_){
+            throw std::runtime_error("snapshot is truncated");
+        }
+        if(length == 0){
+            ended_ = true;
+            buffer_.clear();
+            pos_ = 0;
+            if(!expectEnd){
+                throw std::runtime_error("snapshot is truncated");
+            }
+            return;
+        }
+        if(expectEnd){
+            throw std::runtime_error("snapshot has trailing data");
+        }
+        //save() never writes larger blocks; a bigger length is corruption
+        if(length > SNAPSHOT_BST_BLOCK_SIZE){
+            throw std::runtime_error("snapshot block is too large");
+        }
+        buffer_.resize(length);
+        in_.read(buffer_.data(), length);
+        if(!in_){
+            throw std::runtime_error("snapshot is truncated");
+        }
+        pos_ = 0;
+    }
+
+    std::istream& in_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    bool ended_;
+};
+
+/**
+* Customization point for how keys and values are stored in a snapshot.
+* The default copies the object's bytes, which is only valid for trivially
+* copyable types. Specialize it for anything that owns memory:
+*
+*   template<> struct SnapshotSerializer<MyType>
+*   {
+*       static void write(SnapshotWriter& out, const MyType& value);
+*       static MyType read(SnapshotReader& in);
+*   };
+*/
+template<typename T>
+struct SnapshotSerializer
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+        "specialize SnapshotSerializer for keys/values that are not trivially copyable");
+
+    static void write(SnapshotWriter& out, const T& value)
+    {
+        out.write(&value, sizeof(T));
+    }
+
+    static T read(SnapshotReader& in)
+    {
+        T value;
+        in.read(&value, sizeof(T));
+        return value;
+    }
+};
+
+/**
+* Strings are stored as a uint64_t length followed by their characters.
+*/
+template<>
+struct SnapshotSerializer<std::string>
+{
+    static void write(SnapshotWriter& out, const std::string& value)
+    {
+        uint64_t length = value.size();
+        out.write(&length, sizeof(length));
+        out.write(value.data(), value.size());
+    }
+
+    static std::string read(SnapshotReader& in)
+    {
+        uint64_t length = 0;
+        in.read(&length, sizeof(length));
+        //the length is untrusted, so grow the string only as bytes arrive:
+        //a corrupt one runs into the end of the snapshot, not a huge allocation
+        std::string value;
+        char chunk[4096];
+        while(length > 0){
+            size_t part = (size_t)std::min<uint64_t>(length, sizeof(chunk));
+            in.read(chunk, part);
+            value.append(chunk, part);
+            length -= part;
+        }
+        return value;
+    }
+};
+
+/**
+* Feeds snapshot entries to the bulk build (see buildSubtree()).
+*/
+template<typename Key, typename Value>
+class SnapshotEntrySource
+{
+public:
+    SnapshotEntrySource(SnapshotReader& in) :
+        in_(in),
+        first_(true)
+    {
+
+    }
+
+    // keys must arrive strictly increasing, or the tree built from them
+    // would not be a search tree
+    Key readKey()
+    {
+        Key key = SnapshotSerializer<Key>::read(in_);
+        if(!first_ && !(previous_ < key)){
+            throw std::runtime_error("snapshot keys are out of order");
+        }
+        previous_ = key;
+        first_ = false;
+        return key;
+    }
+
+    Value readValue()
+    {
+        return SnapshotSerializer<Value>::read(in_);
+    }
+
+private:
+    SnapshotReader& in_;
+    Key previous_;
+    bool first_;
+};
+
+/**
+* Writes the tree to out in the snapshot format described above.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::save(std::ostream& out) const
+{
+    uint64_t count = size_;
+
+    uint32_t version = SNAPSHOT_BST_VERSION;
+    out.write("BSTS", 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    SnapshotWriter writer(out);
+    for(iterator it = begin(); it != end(); ++it){
+        SnapshotSerializer<Key>::write(writer, it->first);
+        SnapshotSerializer<Value>::write(writer, it->second);
+    }
+    writer.finish();
+}
+
+/**
+* Replaces the contents of the tree with a snapshot written by save().
+* Since the entries arrive sorted, the tree is built directly in balanced
+* shape in O(n) instead of replaying n inserts. Throws std::runtime_error
+* (leaving the tree empty) if the snapshot is malformed or truncated,
+* including keys that are not strictly increasing.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::load(std::istream& in)
+{
+    clear();
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if(!in || std::memcmp(magic, "BSTS", 4) != 0){
+        throw std::runtime_error("not a BST snapshot");
+    }
+    if(version != SNAPSHOT_BST_VERSION){
+        throw std::runtime_error("unsupported BST snapshot version");
+    }
+
+    SnapshotReader reader(in);
+    SnapshotEntrySource<Key, Value> source(reader);
+    buildFrom(source, count);
+
+    try{
+        reader.finish();
+    }
+    catch(...){
+        clear();
+        throw;
+    }
+}
+
+/**
+* Replaces the contents of the tree with count entries taken in increasing key
+* order from source, in O(n). Source supplies Key readKey() and Value
+* readValue(), called alternately. If source throws, the tree is left empty.
+*/
+template<typename Key, typename Value>
+template<typename Source>
+void BinarySearchTree<Key, Value>::buildFrom(Source& source, uint64_t count)
+{
+    clear();
+    Node<Key, Value>* last = nullptr;
+    int height = 0;
+    root_ = buildSubtree(source, count, last, height);
+    rightmost_ = last;
+    size_ = count;
+}
+
+/**
+* Builds a balanced subtree from the next count entries of source, in order:
+* left subtree, then this node, then the right subtree. The left side gets
+* the smaller half, so sibling heights differ by at most one and the result
+* is also a valid AVL tree. last is set to the largest node built and height
+* to the subtree's height. On error everything built so far is freed.
+*/
+template<typename Key, typename Value>
+template<typename Source>
+Node<Key, Value>* BinarySearchTree<Key, Value>::buildSubtree(Source& source, uint64_t count, Node<Key, Value>*& last, int& height)
+{
+    if(count == 0){
+        height = 0;
+        return nullptr;
+    }
+
+    uint64_t leftCount = (count - 1) / 2;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    Node<Key, Value>* left = buildSubtree(source, leftCount, last, leftHeight);
+
+    Node<Key, Value>* n = nullptr;
+    try{
+        Key key = source.readKey();
+        Value value = source.readValue();
+        n = createNode(key, value, nullptr);
+    }
+    catch(...){
+        deleteTree(left);
+        throw;
+    }
+    n->setLeft(left);
+    if(left){
+        left->setParent(n);
+    }
+    last = n;
+
+    Node<Key, Value>* right = nullptr;
+    try{
+        right = buildSubtree(source, count - 1 - leftCount, last, rightHeight);
+    }
+    catch(...){
+        deleteTree(n);
+        throw;
+    }
+    n->setRight(right);
+    if(right){
+        right->setParent(n);
+    }
+
+    setBuiltBalance(n, (int8_t)(rightHeight - leftHeight));
+    height = std::max(leftHeight, rightHeight) + 1;
+    return n;
+}
+
+#endif
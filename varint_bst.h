@@ -0,0 +1,280 @@
+#include <type_traits>
+
+#ifndef VARINT_BST_H
+#define VARINT_BST_H
+
+// Compressed export for integer-keyed trees: BinarySearchTree::saveVarint() / loadVarint()
+//
+// Dense, increasing integer keys are mostly small gaps, so storing each key
+// as a LEB128 varint of its distance from the previous key usually takes one
+// byte instead of eight.
+//
+// Format (version 1):
+//   "BSTV"              4-byte magic
+//   uint32_t version
+//   uint64_t count      number of entries
+//   uint32_t blockEntries
+//   payload             in the snapshot block format (see snapshot_bst.h)
+//
+// The payload holds the data blocks and then the block index. Every data
+// block except possibly the last holds blockEntries entries:
+//   varint n            entries in this block
+//   varint firstKey     stored whole, so a block decodes on its own
+//   value
+//   n-1 times: varint (key - previous key), value
+// The index is a varint block count followed by, per block, varint firstKey
+// and varint payload offset of the block. That is enough for a reader to
+// seek straight to the block holding a key. loadVarint() reads everything in
+// order and feeds the linear bulk build, using the index only as a
+// consistency check.
+//
+// Integral values are varints too, zigzag encoded if signed. Any other value
+// type goes through SnapshotSerializer<Value>.
+
+#define VARINT_BST_VERSION 1
+
+/**
+* LEB128 varint and zigzag helpers over the snapshot reader/writer.
+*/
+struct VarintCodec
+{
+    static void write(SnapshotWriter& out, uint64_t value)
+    {
+        while(value >= 0x80){
+            out.writeByte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.writeByte((uint8_t)value);
+    }
+
+    static uint64_t read(SnapshotReader& in)
+    {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7){
+            uint8_t byte = in.readByte();
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if(!(byte & 0x80)){
+                return value;
+            }
+        }
+        throw std::runtime_error("varint is too long");
+    }
+
+    static uint64_t zigzag(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t value)
+    {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    // value encoders, picked by tag dispatch on whether Value is integral
+    template<typename T>
+    static void writeValue(SnapshotWriter& out, const T& value, std::true_type)
+    {
+        write(out, std::is_signed<T>::value ? zigzag((int64_t)value) : (uint64_t)value);
+    }
+
+    template<typename T>
+    static void writeValue(SnapshotWriter& out, const T& value, std::false_type)
+    {
+        SnapshotSerializer<T>::write(out, value);
+    }
+
+    template<typename T>
+    static T readValue(SnapshotReader& in, std::true_type)
+    {
+        uint64_t raw = read(in);
+        return std::is_signed<T>::value ? (T)unzigzag(raw) : (T)raw;
+    }
+
+    template<typename T>
+    static T readValue(SnapshotReader& in, std::false_type)
+    {
+        return SnapshotSerializer<T>::read(in);
+    }
+};
+
+/**
+* Decodes data blocks for the bulk build (see buildSubtree()) and remembers
+* each block's first key so the index can be checked afterwards. Every key,
+* including the first of each block, must fit Key and be larger than the one
+* before it, or the tree built from them would not be a search tree.
+*/
+template<typename Key, typename Value>
+class VarintEntrySource
+{
+public:
+    VarintEntrySource(SnapshotReader& in) :
+        in_(in),
+        leftInBlock_(0),
+        previous_(0),
+        first_(true)
+    {
+
+    }
+
+    Key readKey()
+    {
+        uint64_t raw = 0;
+        if(leftInBlock_ == 0){
+            leftInBlock_ = VarintCodec::read(in_);
+            if(leftInBlock_ == 0){
+                throw std::runtime_error("empty block in varint export");
+            }
+            raw = VarintCodec::read(in_);
+            firstKeys_.push_back(raw);
+        }
+        else{
+            raw = previous_ + VarintCodec::read(in_);
+        }
+
+        //the sum is modular, and a signed key crossing zero wraps it on
+        //purpose, so range and order are checked on Key itself: a zero delta
+        //or one that wraps an unsigned key past its maximum fails here
+        Key key = (Key)raw;
+        if((uint64_t)key != raw){
+            throw std::runtime_error("varint export key does not fit the key type");
+        }
+        if(!first_ && !((Key)previous_ < key)){
+            throw std::runtime_error("varint export keys are out of order");
+        }
+        previous_ = raw;
+        first_ = false;
+        --leftInBlock_;
+        return key;
+    }
+
+    Value readValue()
+    {
+        return VarintCodec::readValue<Value>(in_, typename std::is_integral<Value>::type());
+    }
+
+    bool blockDone() const
+    {
+        return leftInBlock_ == 0;
+    }
+
+    const std::vector<uint64_t>& firstKeys() const
+    {
+        return firstKeys_;
+    }
+
+private:
+    SnapshotReader& in_;
+    uint64_t leftInBlock_;
+    uint64_t previous_;
+    bool first_;
+    std::vector<uint64_t> firstKeys_;
+};
+
+/**
+* Writes the tree in the compressed format described above. Only integral key
+* types are accepted. blockEntries trades index size against how much a
+* seeking reader has to decode to reach a key.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::saveVarint(std::ostream& out, uint32_t blockEntries) const
+{
+    static_assert(std::is_integral<Key>::value, "saveVarint() needs an integral key type");
+    if(blockEntries == 0){
+        blockEntries = 1;
+    }
+
+    uint64_t count = size_;
+
+    uint32_t version = VARINT_BST_VERSION;
+    out.write("BSTV", 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(&blockEntries), sizeof(blockEntries));
+
+    SnapshotWriter writer(out);
+    std::vector<uint64_t> firstKeys;
+    std::vector<uint64_t> offsets;
+    uint64_t previous = 0;
+    uint64_t left = count;
+    uint64_t inBlock = 0;
+
+    for(iterator it = begin(); it != end(); ++it){
+        uint64_t key = (uint64_t)it->first;
+        if(inBlock == 0){
+            inBlock = std::min<uint64_t>(blockEntries, left);
+            firstKeys.push_back(key);
+            offsets.push_back(writer.written());
+            VarintCodec::write(writer, inBlock);
+            VarintCodec::write(writer, key);
+        }
+        else{
+            VarintCodec::write(writer, key - previous);
+        }
+        VarintCodec::writeValue(writer, it->second, typename std::is_integral<Value>::type());
+        previous = key;
+        --inBlock;
+        --left;
+    }
+
+    VarintCodec::write(writer, firstKeys.size());
+    for(size_t i = 0; i < firstKeys.size(); i++){
+        VarintCodec::write(writer, firstKeys[i]);
+        VarintCodec::write(writer, offsets[i]);
+    }
+    writer.finish();
+}
+
+/**
+* Replaces the contents of the tree with an export written by saveVarint(),
+* decoding straight into the O(n) bulk build. Throws std::runtime_error
+* (leaving the tree empty) if the input is malformed, including keys that do
+* not fit Key or are not strictly increasing.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::loadVarint(std::istream& in)
+{
+    static_assert(std::is_integral<Key>::value, "loadVarint() needs an integral key type");
+    clear();
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    uint32_t blockEntries = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    in.read(reinterpret_cast<char*>(&blockEntries), sizeof(blockEntries));
+    if(!in || std::memcmp(magic, "BSTV", 4) != 0){
+        throw std::runtime_error("not a varint BST export");
+    }
+    if(version != VARINT_BST_VERSION){
+        throw std::runtime_error("unsupported varint BST export version");
+    }
+
+    SnapshotReader reader(in);
+    VarintEntrySource<Key, Value> source(reader);
+    buildFrom(source, count);
+
+    try{
+        if(!source.blockDone()){
+            throw std::runtime_error("varint export has a short block");
+        }
+        const std::vector<uint64_t>& firstKeys = source.firstKeys();
+        if(VarintCodec::read(reader) != firstKeys.size()){
+            throw std::runtime_error("varint export index does not match its blocks");
+        }
+        for(size_t i = 0; i < firstKeys.size(); i++){
+            if(VarintCodec::read(reader) != firstKeys[i]){
+                throw std::runtime_error("varint export index does not match its blocks");
+            }
+            VarintCodec::read(reader);
+        }
+        reader.finish();
+    }
+    catch(...){
+        clear();
+        throw;
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "journaled_avlbst.h"
+
+using namespace std;
+
+// Measures JournaledAVLTree insert/remove throughput for a range of
+// group-commit sizes. Each group costs one write + fsync, so the fsync
+// latency of the disk holding basePath dominates small groups.
+//
+// usage: ./wal-bench [numOps] [basePath]
+
+void removeFiles(const string& base)
+{
+    remove((base + ".snap").c_str());
+    remove((base + ".snap.tmp").c_str());
+    remove((base + ".wal").c_str());
+    remove((base + ".wal.old").c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    string base = argc > 2 ? argv[2] : "wal-bench.tmp";
+    if(n <= 0){
+        cerr << "usage: " << argv[0] << " [numOps] [basePath]" << endl;
+        return 1;
+    }
+
+    const size_t groupSizes[] = {1, 4, 16, 64, 256, 1024};
+
+    cout << "JournaledAVLTree, " << n << " ops (3 inserts : 1 remove)" << endl;
+    cout << setw(8) << "group" << setw(14) << "ops/sec" << setw(14) << "fsyncs" << setw(14) << "us/op" << endl;
+
+    for(size_t g = 0; g < sizeof(groupSizes) / sizeof(groupSizes[0]); g++){
+        removeFiles(base);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        {
+            JournaledAVLTree<uint64_t, uint64_t> tree(base, groupSizes[g]);
+            uint64_t key = 0;
+            for(int i = 0; i < n; i++){
+                key = key * 6364136223846793005ULL + 1442695040888963407ULL;
+                if(i % 4 == 3){
+                    tree.remove((key >> 33) % (uint64_t)n);
+                }
+                else{
+                    tree.insert(make_pair((key >> 33) % (uint64_t)n, (uint64_t)i));
+                }
+            }
+            tree.commit();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        cout << setw(8) << groupSizes[g]
+             << setw(14) << fixed << setprecision(0) << n / elapsed.count()
+             << setw(14) << (n + groupSizes[g] - 1) / groupSizes[g]
+             << setw(14) << setprecision(2) << elapsed.count() * 1e6 / n << endl;
+    }
+    removeFiles(base);
+    return 0;
+}